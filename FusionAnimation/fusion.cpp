@@ -12,104 +12,44 @@
 #include <QSlider>
 #include <QLabel>
 #include <QFileDialog>
+#include <QDoubleSpinBox>
+#include <QElapsedTimer>
+#include <QMessageBox>
 #include <QtMath>
+#include "frameview.h"
+#include "pipeline.h"
+#include "sequence.h"
+#include "trace.h"
+#include "tracetoggle.h"
 
 const QSize canvasSize(512, 512);
 
-QImage loadAndResize(const QString& path) {
-    QImage img(path);
-    return img.scaled(canvasSize, Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation).copy(QRect(QPoint(0, 0), canvasSize));
-}
-
-QImage generateFractal(double zoom, int time) {
-    QImage img(canvasSize, QImage::Format_RGB32);
-    const int w = canvasSize.width(), h = canvasSize.height();
-    double cx = -0.7, cy = 0.27015;
-    #pragma omp parallel for
-    for (int y = 0; y < h; ++y) {
-        for (int x = 0; x < w; ++x) {
-            double zx = 1.5 * (x - w / 2) / (0.5 * zoom * w);
-            double zy = (y - h / 2) / (0.5 * zoom * h);
-            int i = 0;
-            while (zx*zx + zy*zy < 4 && i < 255) {
-                double tmp = zx * zx - zy * zy + cx + 0.1 * sin(time * 0.05);
-                zy = 2.0 * zx * zy + cy;
-                zx = tmp;
-                ++i;
-            }
-            img.setPixel(x, y, qRgb(i, i, i));
-        }
-    }
-    return img;
-}
-
-QImage blendFusion(const QImage& imgA, const QImage& imgB, float blendAmount, float warpAmount, int time) {
-    QImage result(canvasSize, QImage::Format_RGB32);
-    for (int y = 0; y < canvasSize.height(); ++y) {
-        for (int x = 0; x < canvasSize.width(); ++x) {
-            int xx = x + warpAmount * sin(2 * 3.14 * y / 128 + time * 0.05);
-            int yy = y + warpAmount * cos(2 * 3.14 * x / 128 + time * 0.05);
-            if (xx < 0 || xx >= canvasSize.width() || yy < 0 || yy >= canvasSize.height()) continue;
-
-            QColor ca = imgA.pixelColor(x, y);
-            QColor cb = imgB.pixelColor(xx, yy);
-
-            QColor mixed(
-                ca.red() * (1 - blendAmount) + cb.red() * blendAmount,
-                ca.green() * (1 - blendAmount) + cb.green() * blendAmount,
-                ca.blue() * (1 - blendAmount) + cb.blue() * blendAmount
-            );
-            result.setPixelColor(x, y, mixed);
-        }
-    }
-    return result;
-}
-
-QImage applyTileSpin(const QImage& src, float angleDeg, int tiles) {
-    QImage result(canvasSize, QImage::Format_RGB32);
-    QPainter p(&result);
-    int tileW = canvasSize.width() / tiles;
-    int tileH = canvasSize.height() / tiles;
-
-    for (int y = 0; y < tiles; ++y) {
-        for (int x = 0; x < tiles; ++x) {
-            QRect rect(x * tileW, y * tileH, tileW, tileH);
-            p.save();
-            p.translate(rect.center());
-            p.rotate(angleDeg);
-            p.translate(-rect.center());
-            p.drawImage(rect, src, rect);
-            p.restore();
-        }
-    }
-    return result;
-}
-
-QImage applyGoovieEffect(const QImage& src, float strength, int time) {
-    QImage result(canvasSize, QImage::Format_RGB32);
-    int w = canvasSize.width(), h = canvasSize.height();
-    QPoint center(w/2, h/2);
-
-    for (int y = 0; y < h; ++y) {
-        for (int x = 0; x < w; ++x) {
-            QPointF dir = QPointF(x - center.x(), y - center.y());
-            float dist = std::hypot(dir.x(), dir.y());
-            float factor = strength * std::sin(dist / 20.0 - time * 0.1);
-            QPoint srcPt = QPoint(x + dir.x() * factor * 0.01, y + dir.y() * factor * 0.01);
-            if (srcPt.x() >= 0 && srcPt.x() < w && srcPt.y() >= 0 && srcPt.y() < h)
-                result.setPixelColor(x, y, src.pixelColor(srcPt));
-        }
-    }
-    return result;
+// A face is a still unless the user asks for the numbered run it belongs to;
+// 'sequence' says which. Returns an empty path if they cancel.
+static QString pickFace(const QString &face, bool &sequence) {
+    QMessageBox ask;
+    ask.setWindowTitle("QFusionRoom FX");
+    ask.setText(QString("Open %1 as a still image or as a numbered image sequence?").arg(face));
+    QPushButton *still = ask.addButton("Open Image...", QMessageBox::AcceptRole);
+    QPushButton *run = ask.addButton("Open Sequence...", QMessageBox::AcceptRole);
+    ask.addButton(QMessageBox::Cancel);
+    ask.setDefaultButton(still);
+    ask.exec();
+    sequence = ask.clickedButton() == run;
+    if (!sequence && ask.clickedButton() != still)
+        return QString();
+    return QFileDialog::getOpenFileName(nullptr, sequence ? QString("Select the frame of the %1 sequence to start from").arg(face)
+                                                          : QString("Select %1").arg(face));
 }
 
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
+    goo::trace::startFromEnvironment();
     QWidget window;
     window.setWindowTitle("QFusionRoom FX");
     QVBoxLayout* mainLayout = new QVBoxLayout(&window);
 
-    QLabel* preview = new QLabel;
+    goo::FrameView* preview = new goo::FrameView;
     preview->setFixedSize(canvasSize);
     mainLayout->addWidget(preview);
 
@@ -124,6 +64,9 @@ int main(int argc, char *argv[]) {
     sliders->addWidget(new QLabel("Zoom")); sliders->addWidget(zoomSlider);
     sliders->addWidget(new QLabel("Spin")); sliders->addWidget(spinSlider);
     sliders->addWidget(new QLabel("Warp")); sliders->addWidget(warpSlider);
+    QDoubleSpinBox *fpsBox = new QDoubleSpinBox;
+    fpsBox->setRange(1, 120); fpsBox->setValue(30);
+    sliders->addWidget(new QLabel("FPS")); sliders->addWidget(fpsBox);
     mainLayout->addLayout(sliders);
 
     QHBoxLayout* buttons = new QHBoxLayout;
@@ -132,36 +75,65 @@ int main(int argc, char *argv[]) {
     buttons->addWidget(startBtn); buttons->addWidget(stopBtn);
     mainLayout->addLayout(buttons);
 
-    QString pathA = QFileDialog::getOpenFileName(nullptr, "Select Face A");
-    QString pathB = QFileDialog::getOpenFileName(nullptr, "Select Face B");
-    if (pathA.isEmpty() || pathB.isEmpty()) return 0;
-
-    QImage imgA = loadAndResize(pathA);
-    QImage imgB = loadAndResize(pathB);
+    bool sequenceA = false, sequenceB = false;
+    QString pathA = pickFace("Face A", sequenceA);
+    if (pathA.isEmpty()) return 0;
+    QString pathB = pickFace("Face B", sequenceB);
+    if (pathB.isEmpty()) return 0;
+
+    goo::FrameSequence seqA, seqB;
+    const bool openedA = seqA.open(pathA, canvasSize, sequenceA);
+    if (!openedA || !seqB.open(pathB, canvasSize, sequenceB)) {
+        QMessageBox::warning(nullptr, "Open Images", "Could not load " + (openedA ? pathB : pathA));
+        return 0;
+    }
     QTimer* timer = new QTimer;
+    timer->setTimerType(Qt::PreciseTimer);
     int time = 0;
 
+    // Sequence frames follow the wall clock, not the tick count, so a slow
+    // tick drops frames instead of slowing the footage down. 'playFps' is the
+    // rate the clock has been running at since it was last restarted.
+    QElapsedTimer playClock;
+    double playedFrames = 0;
+    double playFps = fpsBox->value();
+    auto sequenceFrame = [&]() { return qint64(playedFrames + playClock.elapsed() * playFps / 1000.0); };
+
+    goo::FusionPipeline pipeline;
+
     QObject::connect(timer, &QTimer::timeout, [&]() {
-        float blend = blendSlider->value() / 100.0f;
-        float zoom = zoomSlider->value();
-        float spin = spinSlider->value();
-        float warp = warpSlider->value();
-
-        QImage fused = blendFusion(imgA, imgB, blend, warp, time);
-      //  QImage fractal = generateFractal(zoom, time);
-        QImage combo(canvasSize, QImage::Format_RGB32);
-        QPainter p(&combo);
-       // p.drawImage(0, 0, fractal);
-        p.setOpacity(0.7);
-        p.drawImage(0, 0, applyTileSpin(fused, spin + time, 4));
-        p.end();
-
-        preview->setPixmap(QPixmap::fromImage(applyGoovieEffect(combo, warp, time)));
+        GOO_TRACE_SCOPE("tick");
+        goo::FusionPipeline::Params params;
+        params.blend = blendSlider->value() / 100.0f;
+        params.zoom = zoomSlider->value();
+        params.spin = spinSlider->value();
+        params.warp = warpSlider->value();
+
+        const qint64 n = sequenceFrame();
+        preview->setFrame(&pipeline.render(seqA.frame(n), seqB.frame(n), params, time));
         time++;
     });
 
-    QObject::connect(startBtn, &QPushButton::clicked, [&]() { timer->start(33); });
-    QObject::connect(stopBtn, &QPushButton::clicked, [&]() { timer->stop(); });
+    QObject::connect(startBtn, &QPushButton::clicked, [&]() {
+        if (timer->isActive()) return;
+        playFps = fpsBox->value();
+        playClock.start();
+        timer->start(qMin(33, int(1000 / fpsBox->value())));
+    });
+    QObject::connect(stopBtn, &QPushButton::clicked, [&]() {
+        if (!timer->isActive()) return;
+        playedFrames = sequenceFrame();
+        timer->stop();
+    });
+    QObject::connect(fpsBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged), [&](double fps) {
+        if (!timer->isActive()) return;
+        // Bank what was played at the old rate, change the pace from here
+        playedFrames += playClock.restart() * playFps / 1000.0;
+        playFps = fps;
+        timer->setInterval(qMin(33, int(1000 / fps)));
+    });
+
+    goo::trace::installToggleShortcut(&window);
 
     window.show();
     return app.exec();
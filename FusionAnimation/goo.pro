@@ -27,6 +27,8 @@ LIBS += -L/Users/macbook2015/Desktop/brew/lib
 
 INCLUDEPATH += /Users/macbook2015/Desktop/brew/include /Users/macbook2015/Desktop/brew/lib
 
+include(../goocore/goocore.pri)
+
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
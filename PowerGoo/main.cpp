@@ -0,0 +1,350 @@
+#include <QApplication>
+#include <QWidget>
+#include <QImage>
+#include <QPainter>
+#include <QMouseEvent>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QPushButton>
+#include <QSlider>
+#include <QLabel>
+#include <QRadioButton>
+#include <QButtonGroup>
+#include <QFileDialog>
+#include <QGroupBox>
+#include <QCheckBox>
+#include <QMessageBox>
+#include <QFileInfo>
+#include <QScreen>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <qmath.h>
+#include <QPointF>
+#include "goocore.h"
+#include "imageload.h"
+#include "session.h"
+#include "trace.h"
+#include "tracetoggle.h"
+
+class GooWidget : public QWidget {
+    QString sourcePath;
+    QImage originalImage, currentImage;
+    QImage scratch; // the warp writes here, then the dab is copied back
+    QImage display; // 8-bit copy for the screen when working in 16 bits
+    goo::ProxiedImage opening; // its proxy is shown while the full image loads
+    bool highPrecision = false;
+    QPoint lastPos;
+    float radius = 100.0f;
+    float force = 10.0f;
+    goo::BrushType brush = goo::Brush_Smear;
+
+    // An opened session stays mapped; its tiles load as they are needed
+    std::unique_ptr<goo::SessionReader> session;
+    goo::LazyTiles pendingTiles;
+
+public:
+    GooWidget(QWidget *parent = nullptr) : QWidget(parent) {
+        QString path = QFileDialog::getOpenFileName(this, "Load Image (or a .goo session)");
+        if (path.isEmpty()) exit(1);
+        bool ok = path.endsWith(".goo", Qt::CaseInsensitive) ? loadSession(path) : loadImage(path);
+        if (!ok) exit(1);
+    }
+
+    // 8-bit straight ARGB, or 16-bit premultiplied so strokes do not band
+    QImage::Format workFormat() const {
+        return highPrecision ? goo::PixelTraits<QRgba64>::format() : goo::PixelTraits<QRgb>::format();
+    }
+
+    // A proxy no bigger than the screen is decoded at that size and shown
+    // at once; the image itself loads on the thread pool and replaces it
+    // when it is done, or as soon as anything needs it.
+    bool loadImage(const QString &path) {
+        GOO_TRACE_SCOPE("loadImage");
+        goo::ProxiedImage next;
+        auto fitScreen = [](const QSize &fileSize) {
+            QSize bound = fileSize;
+            if (QScreen *screen = QGuiApplication::primaryScreen())
+                bound = bound.boundedTo(screen->availableGeometry().size());
+            return fileSize.scaled(bound, Qt::KeepAspectRatio);
+        };
+        if (!next.open(path, fitScreen, QImage::Format_ARGB32_Premultiplied, workFormat()))
+            return false;
+        pendingTiles.clear();
+        session.reset();
+        sourcePath = path;
+        opening = next;
+        const QFuture<QImage> load = opening.fullLoad();
+        opening.whenLoaded(this, [this, load]() {
+            if (opening.fullLoad() == load)
+                finishLoading();
+        });
+        if (!opening.loading())
+            finishLoading();
+        setFixedSize(next.fileSize());
+        update();
+        return true;
+    }
+
+    // Swaps the loaded image in for the proxy, waiting for it if need be
+    void finishLoading() {
+        if (opening.proxy().isNull())
+            return;
+        setImage(opening.full());
+        opening.clear();
+        update();
+    }
+
+    // The Ungoo source and the image start out sharing pixels; the first
+    // stroke detaches them
+    void setImage(const QImage &img) {
+        originalImage = img;
+        currentImage = img;
+        refreshDisplay(currentImage.rect());
+    }
+
+    // Converts the image, and the Ungoo source, to the other precision
+    void setHighPrecision(bool on) {
+        if (on == highPrecision)
+            return;
+        finishLoading();
+        pendingTiles.ensureAll(currentImage);
+        pendingTiles.clear();
+        session.reset();
+        highPrecision = on;
+        currentImage = currentImage.convertToFormat(workFormat());
+        if (!originalImage.isNull())
+            originalImage = originalImage.convertToFormat(workFormat());
+        scratch = QImage();
+        refreshDisplay(currentImage.rect());
+        update();
+    }
+
+    bool isHighPrecision() const { return highPrecision; }
+
+    void refreshDisplay(const QRect &area) {
+        if (!highPrecision) {
+            display = QImage();
+            return;
+        }
+        if (display.size() != currentImage.size())
+            display = QImage(currentImage.size(), QImage::Format_ARGB32_Premultiplied);
+        const QRect r = area.intersected(currentImage.rect());
+        for (int y = r.top(); y <= r.bottom(); ++y) {
+            const QRgba64 *in = reinterpret_cast<const QRgba64*>(currentImage.constScanLine(y));
+            QRgb *out = reinterpret_cast<QRgb*>(display.scanLine(y));
+            for (int x = r.left(); x <= r.right(); ++x)
+                out[x] = in[x].toArgb32();
+        }
+    }
+
+    // The warped image is stored as tiles, the source only by path: it is
+    // needed again only when Ungoo is used.
+    bool saveSession(const QString &path) {
+        GOO_TRACE_SCOPE("saveSession");
+        finishLoading();
+        pendingTiles.ensureAll(currentImage);
+        pendingTiles.clear();
+        session.reset();
+
+        QMap<QString, QString> meta;
+        meta["app"] = "goo";
+        meta["source"] = sourcePath;
+        meta["radius"] = QString::number(radius);
+        meta["force"] = QString::number(force);
+        meta["brush"] = QString::number(int(brush));
+        meta["precision"] = highPrecision ? "16" : "8";
+
+        goo::SessionWriter writer(path);
+        if (!writer.open())
+            return false;
+        writer.addMeta(meta);
+        writer.addImage(0, currentImage);
+        return writer.finish();
+    }
+
+    bool loadSession(const QString &path) {
+        GOO_TRACE_SCOPE("loadSession");
+        // Opened on the side: the current session may still have tiles to load
+        std::unique_ptr<goo::SessionReader> next(new goo::SessionReader);
+        if (!next->open(path))
+            return false;
+        const QMap<QString, QString> meta = next->meta();
+        QImage img = next->allocImage(0);
+        goo::LazyTiles tiles;
+        if (meta.value("app") != "goo" || img.isNull() || !tiles.reset(next.get(), 0, img))
+            return false;
+        pendingTiles = tiles;
+        session = std::move(next);
+        opening.clear();
+        currentImage = img;
+        highPrecision = img.format() == goo::PixelTraits<QRgba64>::format();
+        refreshDisplay(QRect()); // filled in as tiles load
+        sourcePath = meta.value("source");
+        originalImage = QImage();
+        radius = meta.value("radius", "100").toFloat();
+        force = meta.value("force", "10").toFloat();
+        brush = static_cast<goo::BrushType>(qBound(0, meta.value("brush").toInt(), int(goo::Brush_Ungoo)));
+        setFixedSize(currentImage.size());
+        update();
+        return true;
+    }
+
+    void setBrush(goo::BrushType b) { brush = b; }
+    void setRadius(int r) { radius = r; }
+    void setForce(int f) { force = f; }
+    goo::BrushType currentBrush() const { return brush; }
+    int radiusValue() const { return qRound(radius); }
+    int forceValue() const { return qRound(force); }
+
+    void paintEvent(QPaintEvent *e) override {
+        GOO_TRACE_SCOPE("paint");
+        if (pendingTiles.pending())
+            refreshDisplay(pendingTiles.ensure(currentImage, e->rect()));
+        QPainter p(this);
+        if (!opening.proxy().isNull())
+            p.drawImage(rect(), opening.proxy());
+        else
+            p.drawImage(0, 0, highPrecision ? display : currentImage);
+    }
+
+    void mousePressEvent(QMouseEvent *e) override {
+        lastPos = e->pos();
+    }
+
+    void mouseMoveEvent(QMouseEvent *e) override {
+        QPointF center = lastPos;
+        QPointF dir = e->pos() - lastPos;
+        if (!dir.isNull()) {
+            update(applyWarp(center, dir));
+            lastPos = e->pos();
+        }
+    }
+
+    // Returns the pixels that changed
+    QRect applyWarp(QPointF location, QPointF direction) {
+        GOO_TRACE_SCOPE("brush");
+        finishLoading();
+        if (pendingTiles.pending()) {
+            // Everything the brush can read: the dab plus the furthest offset
+            float reach = radius + 2 + force / radius * (1 + QLineF(QPointF(), direction).length()) + 0.01f * force * radius;
+            refreshDisplay(pendingTiles.ensure(currentImage, QRectF(location - QPointF(reach, reach), QSizeF(2 * reach, 2 * reach)).toAlignedRect()));
+        }
+        if (brush == goo::Brush_Ungoo && originalImage.isNull()) {
+            originalImage = QImage(sourcePath).convertToFormat(workFormat());
+            if (originalImage.size() != currentImage.size())
+                originalImage = QImage();
+            if (originalImage.isNull())
+                return QRect(); // nothing to restore from
+        }
+
+        if (scratch.size() != currentImage.size() || scratch.format() != currentImage.format())
+            scratch = QImage(currentImage.size(), currentImage.format());
+
+        goo::Stroke stroke;
+        stroke.brush = brush;
+        stroke.location = location;
+        stroke.direction = direction;
+        stroke.radius = radius;
+        stroke.force = force;
+        QRect r;
+        if (highPrecision)
+            r = goo::warp(goo::constView<QRgba64>(currentImage), goo::constView<QRgba64>(originalImage), goo::view<QRgba64>(scratch), stroke);
+        else
+            r = goo::warp(goo::constView(currentImage), goo::constView(originalImage), goo::view(scratch), stroke);
+
+        const int bpp = currentImage.depth() / 8;
+        for (int y = r.top(); y <= r.bottom(); ++y)
+            memcpy(currentImage.scanLine(y) + r.left() * bpp, scratch.constScanLine(y) + r.left() * bpp, r.width() * bpp);
+        refreshDisplay(r);
+        return r;
+    }
+};
+
+int main(int argc, char *argv[]) {
+    QApplication app(argc, argv);
+    goo::trace::startFromEnvironment();
+
+    QWidget *window = new QWidget;
+    QVBoxLayout *mainLayout = new QVBoxLayout(window);
+
+    // Canvas
+    GooWidget *canvas = new GooWidget();
+
+    // Controls
+    QHBoxLayout *controls = new QHBoxLayout;
+
+    QSlider *radiusSlider = new QSlider(Qt::Horizontal);
+    radiusSlider->setRange(10, 200);
+    radiusSlider->setValue(100);
+    QObject::connect(radiusSlider, &QSlider::valueChanged, canvas, &GooWidget::setRadius);
+
+    QSlider *forceSlider = new QSlider(Qt::Horizontal);
+    forceSlider->setRange(1, 50);
+    forceSlider->setValue(10);
+    QObject::connect(forceSlider, &QSlider::valueChanged, canvas, &GooWidget::setForce);
+
+    QGroupBox *brushBox = new QGroupBox("Brush");
+    QVBoxLayout *brushLayout = new QVBoxLayout;
+    QButtonGroup *brushGroup = new QButtonGroup(window);
+    QStringList brushNames = {"Smear", "Grow", "Shrink", "Pinch", "Ungoo"};
+    for (int i = 0; i < brushNames.size(); ++i) {
+        QRadioButton *btn = new QRadioButton(brushNames[i]);
+        if (i == 0) btn->setChecked(true);
+        brushGroup->addButton(btn, i);
+        brushLayout->addWidget(btn);
+    }
+    QObject::connect(brushGroup, QOverload<int>::of(&QButtonGroup::buttonClicked), [=](int id) {
+        canvas->setBrush(static_cast<goo::BrushType>(id));
+    });
+    brushBox->setLayout(brushLayout);
+
+    QCheckBox *precisionBox = new QCheckBox("16-bit");
+    precisionBox->setToolTip("Work in 16 bits per channel so repeated strokes do not band");
+    precisionBox->setChecked(canvas->isHighPrecision());
+    QObject::connect(precisionBox, &QCheckBox::toggled, canvas, &GooWidget::setHighPrecision);
+
+    QPushButton *saveBtn = new QPushButton("Save Session...");
+    QObject::connect(saveBtn, &QPushButton::clicked, [=]() {
+        QString path = QFileDialog::getSaveFileName(window, "Save Session", "untitled.goo", "Goo sessions (*.goo)");
+        if (!path.isEmpty() && !canvas->saveSession(path))
+            QMessageBox::warning(window, "Save Session", "Could not write " + path);
+    });
+
+    QPushButton *openBtn = new QPushButton("Open...");
+    QObject::connect(openBtn, &QPushButton::clicked, [=]() {
+        QString path = QFileDialog::getOpenFileName(window, "Open Image or Session");
+        if (path.isEmpty())
+            return;
+        bool ok = path.endsWith(".goo", Qt::CaseInsensitive) ? canvas->loadSession(path) : canvas->loadImage(path);
+        if (!ok) {
+            QMessageBox::warning(window, "Open", "Could not open " + path);
+            return;
+        }
+        radiusSlider->setValue(canvas->radiusValue());
+        forceSlider->setValue(canvas->forceValue());
+        brushGroup->button(canvas->currentBrush())->setChecked(true);
+        precisionBox->setChecked(canvas->isHighPrecision());
+    });
+
+    // Add controls
+    controls->addWidget(new QLabel("Radius"));
+    controls->addWidget(radiusSlider);
+    controls->addWidget(new QLabel("Force"));
+    controls->addWidget(forceSlider);
+    controls->addWidget(brushBox);
+    controls->addWidget(precisionBox);
+    controls->addWidget(openBtn);
+    controls->addWidget(saveBtn);
+
+    // Layout
+    mainLayout->addLayout(controls);
+    mainLayout->addWidget(canvas);
+    window->setLayout(mainLayout);
+    goo::trace::installToggleShortcut(window);
+
+    window->setWindowTitle("Kai's Power Goo Clone");
+    window->show();
+
+    return app.exec();
+}
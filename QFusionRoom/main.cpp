@@ -6,6 +6,7 @@
 #include <QHBoxLayout>
 #include <QPushButton>
 #include <QMouseEvent>
+#include <QWheelEvent>
 #include <QFileDialog>
 #include <QSlider>
 #include <QLabel>
@@ -14,102 +15,574 @@
 #include <QGroupBox>
 #include <QTransform>
 #include <QObject>
+#include <QCheckBox>
+#include <QComboBox>
+#include <QMessageBox>
+#include <QFile>
+#include <QFileInfo>
+#include <QScreen>
+#include <QShortcut>
+#include <QHash>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QInputDialog>
+#include <QtConcurrent>
+#include <QtEndian>
+#include <QtMath>
+#include <vector>
+#include <functional>
+#include <cstring>
+#include "align.h"
+#include "batch.h"
+#include "frameview.h"
+#include "goocore.h"
+#include "imageload.h"
+#include "layers.h"
+#include "morph.h"
+#include "pyramid.h"
+#include "session.h"
+#include "trace.h"
+#include "tracetoggle.h"
 
 enum ToolMode {
-    Tool_PaintA,
-    Tool_PaintB,
+    Tool_Paint,
     Tool_Smear,
     Tool_Smooth,
-    Tool_MoveA,
-    Tool_MoveB
+    Tool_Move,
+    Tool_MorphPoints
 };
+
+enum BlendMode {
+    Blend_Linear,
+    Blend_MultiBand
+};
+
 QPoint dragStart;
-QPoint originalOffset;
+QPointF originalOffset;
 
+// Undo/redo for mask edits. Tools report the rect they are about to write;
+// the first time a stroke touches a 64px tile of a plane its old contents are
+// kept. When
+// the stroke ends, each touched tile's before and after states are
+// qCompress'd into one step. Masks are mostly flat, so a step is usually a few
+// hundred bytes and the whole history fits a small budget.
+class MaskHistory {
+    static const int TileSize = 64;
+    static const int MaxSteps = 500;
+    static const qint64 MaxBytes = 8 * 1024 * 1024;
 
-class FusionCanvas : public QWidget {
-    QImage imgA, imgB, mask, fusion;
-    float radius = 50.0f;
-    QPoint offsetA = QPoint(0, 0);
-    QPoint offsetB = QPoint(0, 0);
+    struct Tile {
+        int plane = 0;
+        QRect rect;
+        QByteArray before, after; // compressed
+    };
+    struct Step {
+        QVector<Tile> tiles;
+        QRect bounds;
+        qint64 bytes = 0;
+    };
+    QVector<Step> steps;
+    int applied = 0;        // steps[0, applied) are live, the rest can be redone
+    qint64 totalBytes = 0;
+    QHash<int, QByteArray> pending; // plane * tilesPerPlane + tile -> raw contents before the stroke
+    int tilesX = 0, tilesPerPlane = 0;
+
+    static QByteArray readTile(const QImage &mask, const QRect &r) {
+        const int rowBytes = r.width() * mask.depth() / 8;
+        QByteArray raw(rowBytes * r.height(), Qt::Uninitialized);
+        for (int y = 0; y < r.height(); ++y)
+            memcpy(raw.data() + y * rowBytes, mask.constScanLine(r.top() + y) + r.left() * mask.depth() / 8, rowBytes);
+        return raw;
+    }
+
+    static void writeTile(QImage &mask, const QRect &r, const QByteArray &packed) {
+        const QByteArray raw = qUncompress(packed);
+        const int rowBytes = r.width() * mask.depth() / 8;
+        if (raw.size() != rowBytes * r.height())
+            return;
+        for (int y = 0; y < r.height(); ++y)
+            memcpy(mask.scanLine(r.top() + y) + r.left() * mask.depth() / 8, raw.constData() + y * rowBytes, rowBytes);
+    }
 
-    ToolMode mode = Tool_PaintA;
+    QRect tileRect(const QImage &mask, int index) const {
+        return QRect((index % tilesX) * TileSize, (index / tilesX) * TileSize, TileSize, TileSize).intersected(mask.rect());
+    }
 
 public:
-    FusionCanvas(const QString &pathA, const QString &pathB, QWidget *parent = nullptr) : QWidget(parent) {
-        imgA.load(pathA);
-        imgB.load(pathB);
-        imgA = imgA.convertToFormat(QImage::Format_ARGB32);
-        imgB = imgB.convertToFormat(QImage::Format_ARGB32);
-        imgA = imgA.scaled(400, 400, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-        imgB = imgB.scaled(imgA.size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
-
-        setFixedSize(imgA.size());
-        mask = QImage(imgA.size(), QImage::Format_Grayscale8);
-        mask.fill(128); // 128 = even mix of A and B
+    bool canUndo() const { return applied > 0; }
+    bool canRedo() const { return applied < steps.size(); }
 
-        updateFusion();
+    // Call before writing into 'rect' of the mask planes during a stroke
+    void touch(const QVector<QImage> &planes, const QRect &rect) {
+        const QImage &mask = planes.first();
+        QRect r = rect.intersected(mask.rect());
+        if (r.isEmpty())
+            return;
+        tilesX = (mask.width() + TileSize - 1) / TileSize;
+        tilesPerPlane = tilesX * ((mask.height() + TileSize - 1) / TileSize);
+        for (int plane = 0; plane < planes.size(); ++plane) {
+            for (int ty = r.top() / TileSize; ty <= r.bottom() / TileSize; ++ty) {
+                for (int tx = r.left() / TileSize; tx <= r.right() / TileSize; ++tx) {
+                    int key = plane * tilesPerPlane + ty * tilesX + tx;
+                    if (!pending.contains(key))
+                        pending.insert(key, readTile(planes[plane], tileRect(mask, key % tilesPerPlane)));
+                }
+            }
+        }
     }
 
-    void setRadius(int r) { radius = r; }
-    void setTool(ToolMode m) { mode = m; }
+    // Ends the stroke and records the tiles it actually changed
+    void commit(const QVector<QImage> &planes) {
+        if (pending.isEmpty())
+            return;
+
+        Step step;
+        for (auto it = pending.constBegin(); it != pending.constEnd(); ++it) {
+            const int plane = it.key() / tilesPerPlane;
+            QRect r = tileRect(planes[plane], it.key() % tilesPerPlane);
+            QByteArray now = readTile(planes[plane], r);
+            if (now == it.value())
+                continue;
+            Tile t;
+            t.plane = plane;
+            t.rect = r;
+            t.before = qCompress(it.value());
+            t.after = qCompress(now);
+            step.bytes += t.before.size() + t.after.size();
+            step.bounds |= r;
+            step.tiles.append(t);
+        }
+        pending.clear();
+        if (step.tiles.isEmpty())
+            return;
 
-    void updateFusion() {
-        fusion = QImage(imgA.size(), QImage::Format_ARGB32);
+        // A new edit drops the redo branch
+        while (steps.size() > applied) {
+            totalBytes -= steps.last().bytes;
+            steps.removeLast();
+        }
+        steps.append(step);
+        totalBytes += step.bytes;
+        applied = steps.size();
 
-        for (int y = 0; y < fusion.height(); ++y) {
-            for (int x = 0; x < fusion.width(); ++x) {
-                // Map (x, y) to source positions in A and B
-                QPoint pt(x, y);
-                QPoint ptA = pt - offsetA;
-                QPoint ptB = pt - offsetB;
+        while (steps.size() > 1 && (steps.size() > MaxSteps || totalBytes > MaxBytes)) {
+            totalBytes -= steps.first().bytes;
+            steps.removeFirst();
+            --applied;
+        }
+    }
 
-                QColor cA = Qt::black;
-                QColor cB = Qt::black;
+    // Both return the mask rect that changed, or a null rect
+    QRect undo(QVector<QImage> &planes) {
+        if (!canUndo())
+            return QRect();
+        const Step &step = steps[--applied];
+        for (const Tile &t : step.tiles)
+            writeTile(planes[t.plane], t.rect, t.before);
+        return step.bounds;
+    }
 
-                // Sample A if inside bounds
-                if (imgA.rect().contains(ptA)) {
-                    cA = imgA.pixelColor(ptA);
-                }
+    QRect redo(QVector<QImage> &planes) {
+        if (!canRedo())
+            return QRect();
+        const Step &step = steps[applied++];
+        for (const Tile &t : step.tiles)
+            writeTile(planes[t.plane], t.rect, t.after);
+        return step.bounds;
+    }
+
+    // The whole stack for a session file, tiles still compressed:
+    // u32 applied, u32 steps, then per step u32 tiles and per tile u32
+    // plane, x, y, w, h and the two sized blobs.
+    QByteArray save() const {
+        QByteArray out;
+        auto put = [&](quint32 v) {
+            v = qToLittleEndian(v);
+            out.append(reinterpret_cast<const char*>(&v), 4);
+        };
+        put(applied);
+        put(steps.size());
+        for (const Step &step : steps) {
+            put(step.tiles.size());
+            for (const Tile &t : step.tiles) {
+                put(t.plane);
+                put(t.rect.x());
+                put(t.rect.y());
+                put(t.rect.width());
+                put(t.rect.height());
+                put(t.before.size());
+                out += t.before;
+                put(t.after.size());
+                out += t.after;
+            }
+        }
+        return out;
+    }
+
+    // Rejects (and leaves the history empty) anything that does not fit
+    // 'planes': a tile on a plane or at a place they do not have, or one
+    // that would not unpack to its rect's size.
+    bool restore(const QByteArray &data, const QVector<QImage> &planes) {
+        steps.clear();
+        pending.clear();
+        applied = 0;
+        totalBytes = 0;
+
+        int pos = 0;
+        bool ok = true;
+        auto get = [&]() -> quint32 {
+            if (pos + 4 > data.size()) {
+                ok = false;
+                return 0;
+            }
+            pos += 4;
+            return qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(data.constData()) + pos - 4);
+        };
+        auto blob = [&]() {
+            const int n = int(get());
+            if (!ok || n < 0 || n > data.size() - pos) {
+                ok = false;
+                return QByteArray();
+            }
+            pos += n;
+            return QByteArray(data.constData() + pos - n, n); // deep copy, the source may be a mapping
+        };
+        // qCompress output starts with the unpacked size, big-endian
+        auto unpacksTo = [](const QByteArray &packed, int size) {
+            return packed.size() >= 4
+                && qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(packed.constData())) == quint32(size);
+        };
 
-                // Sample B if inside bounds
-                if (imgB.rect().contains(ptB)) {
-                    cB = imgB.pixelColor(ptB);
+        const int wantApplied = int(get());
+        const int count = int(get());
+        ok = ok && wantApplied >= 0 && count >= 0;
+        for (int i = 0; ok && i < count; ++i) {
+            Step step;
+            const int tiles = int(get());
+            ok = ok && tiles >= 0;
+            for (int j = 0; ok && j < tiles; ++j) {
+                Tile t;
+                t.plane = int(get());
+                const int x = int(get()), y = int(get()), w = int(get()), h = int(get());
+                t.before = blob();
+                t.after = blob();
+                if (!ok || t.plane < 0 || t.plane >= planes.size() || w <= 0 || h <= 0 || w > TileSize || h > TileSize) {
+                    ok = false;
+                    break;
                 }
+                t.rect = QRect(x, y, w, h);
+                const int rawSize = w * h * planes[t.plane].depth() / 8;
+                if (!planes[t.plane].rect().contains(t.rect) || !unpacksTo(t.before, rawSize) || !unpacksTo(t.after, rawSize)) {
+                    ok = false;
+                    break;
+                }
+                step.bytes += t.before.size() + t.after.size();
+                step.bounds |= t.rect;
+                step.tiles.append(t);
+            }
+            steps.append(step);
+            totalBytes += step.bytes;
+        }
+        if (!ok || wantApplied > steps.size()) {
+            steps.clear();
+            totalBytes = 0;
+            return false;
+        }
+        applied = wantApplied;
+        return true;
+    }
+};
+
+// Writes 8-bit RGB rows straight to disk as they are produced, so an export
+// never holds more than one band of the output. Baseline uncompressed TIFF
+// for .tif/.tiff, binary PPM otherwise.
+class RowStreamWriter {
+    QFile file;
+    bool tiff = false;
 
-                // Mask always aligns with fusion
-                int alpha = mask.pixelColor(x, y).red(); // 0–255
-                float blend = alpha / 255.0f;
+    void put16(QByteArray &b, quint16 v) { b.append(char(v & 0xff)).append(char(v >> 8)); }
+    void put32(QByteArray &b, quint32 v) { put16(b, quint16(v & 0xffff)); put16(b, quint16(v >> 16)); }
+    void entry(QByteArray &b, quint16 tag, quint16 type, quint32 count, quint32 value) {
+        put16(b, tag);
+        put16(b, type);
+        put32(b, count);
+        if (type == 3 && count == 1) { // SHORT values are left-aligned
+            put16(b, quint16(value));
+            put16(b, 0);
+        } else {
+            put32(b, value);
+        }
+    }
+
+public:
+    bool open(const QString &path, int width, int height) {
+        QString suffix = QFileInfo(path).suffix().toLower();
+        tiff = (suffix == "tif" || suffix == "tiff");
+        file.setFileName(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+
+        QByteArray header;
+        if (!tiff) {
+            header = QString("P6\n%1 %2\n255\n").arg(width).arg(height).toLatin1();
+            return file.write(header) == header.size();
+        }
+
+        // One IFD right after the header, its out-of-line values after that,
+        // then the pixels as a single strip.
+        const quint16 entries = 12;
+        const quint32 ifdSize = 2 + entries * 12 + 4;
+        const quint32 bitsOffset = 8 + ifdSize;
+        const quint32 xresOffset = bitsOffset + 6;
+        const quint32 yresOffset = xresOffset + 8;
+        const quint32 dataOffset = yresOffset + 8;
+
+        header.append("II*\0", 4);
+        put32(header, 8);
+        put16(header, entries);
+        entry(header, 256, 4, 1, quint32(width));                 // ImageWidth
+        entry(header, 257, 4, 1, quint32(height));                // ImageLength
+        entry(header, 258, 3, 3, bitsOffset);                     // BitsPerSample
+        entry(header, 259, 3, 1, 1);                              // Compression: none
+        entry(header, 262, 3, 1, 2);                              // Photometric: RGB
+        entry(header, 273, 4, 1, dataOffset);                     // StripOffsets
+        entry(header, 277, 3, 1, 3);                              // SamplesPerPixel
+        entry(header, 278, 4, 1, quint32(height));                // RowsPerStrip
+        entry(header, 279, 4, 1, quint32(width) * height * 3);    // StripByteCounts
+        entry(header, 282, 5, 1, xresOffset);                     // XResolution
+        entry(header, 283, 5, 1, yresOffset);                     // YResolution
+        entry(header, 296, 3, 1, 2);                              // ResolutionUnit: inch
+        put32(header, 0);                                         // no next IFD
+        put16(header, 8); put16(header, 8); put16(header, 8);
+        put32(header, 300); put32(header, 1);
+        put32(header, 300); put32(header, 1);
+        return file.write(header) == header.size();
+    }
+
+    bool writeRows(const uchar *rgb, qint64 bytes) {
+        return file.write(reinterpret_cast<const char*>(rgb), bytes) == bytes;
+    }
+
+    void close() { file.close(); }
+};
 
-                QColor mix = QColor::fromRgb(
-                    cA.red()   * (1 - blend) + cB.red()   * blend,
-                    cA.green() * (1 - blend) + cB.green() * blend,
-                    cA.blue()  * (1 - blend) + cB.blue()  * blend
-                );
+class FusionCanvas : public goo::FrameView {
+    static const int ExportBandRows = 64;
+    static const int ExportTileWidth = 512;
 
-                fusion.setPixelColor(x, y, mix);
+    struct Layer {
+        QString path;
+        goo::ProxiedImage source; // a screen-sized proxy everything edits, full resolution for export
+        goo::LayerTransform xf;
+    };
+    QVector<Layer> layers;
+    QVector<QImage> planes; // layer weights, LayersPerPlane to an RGBA8888 plane
+    QImage fusion; // shown as it is, so premultiplied; every pixel is opaque
+    float radius = 50.0f;
+    int current = 0; // layer the paint brush, move tool and flips work on
+    std::vector<QRgb> rowBuf;     // blendLinear scratch, a row per layer
+    std::vector<uchar> weightBuf; // and the weights of one row
+
+    ToolMode mode = Tool_Paint;
+    BlendMode blendMode = Blend_Linear;
+    goo::PyramidBlender blender;
+    goo::MaskBlur smoother;
+    goo::MaskSmear smearer;
+    MaskHistory history;
+    QVector<QPointF> featuresA, featuresB; // morph points on the first two layers' proxies, as flipped
+
+public:
+    FusionCanvas(const QStringList &paths, QWidget *parent = nullptr) : goo::FrameView(parent) {
+        setFrame(&fusion);
+        for (const QString &path : paths)
+            addLayer(path);
+    }
+
+    // Decodes a source into 'layer'. The first one sets the canvas size:
+    // 'canvasSize' if it is valid, else fitted to the screen. Later ones fit
+    // inside 'canvasSize'.
+    //
+    // Only the proxy is decoded here, straight at its size; the full
+    // resolution follows on the thread pool and is taken when it is done,
+    // or waited for by whatever needs it first.
+    bool openLayer(const QString &path, const QSize &canvasSize, bool first, Layer &layer) {
+        layer.path = path;
+        auto proxySize = [&](const QSize &fileSize) {
+            if (!first)
+                return fileSize.scaled(canvasSize, Qt::KeepAspectRatio);
+            if (canvasSize.isValid())
+                return canvasSize;
+            // Edit on proxies sized to share the screen with the A and B views
+            QSize bound(400, 400);
+            if (QScreen *screen = QGuiApplication::primaryScreen()) {
+                QSize avail = screen->availableGeometry().size();
+                bound = QSize(avail.width() / 3, avail.height() * 2 / 3);
+            }
+            return fileSize.scaled(bound.boundedTo(fileSize), Qt::KeepAspectRatio);
+        };
+        // Premultiplied: the source views show it as it is, and the blends,
+        // which ignore alpha, then see it over black
+        const QImage::Format format = QImage::Format_ARGB32_Premultiplied;
+        if (!layer.source.open(path, proxySize, format, format))
+            return false;
+        const QFuture<QImage> load = layer.source.fullLoad();
+        layer.source.whenLoaded(this, [this, load]() {
+            for (Layer &l : layers)
+                if (l.source.fullLoad() == load)
+                    l.source.full();
+        });
+        return true;
+    }
+
+    // Adds another source; two layers start as an even mix, later ones with
+    // no weight until painted in
+    bool addLayer(const QString &path) {
+        if (layers.size() >= goo::MaxLayers)
+            return false;
+        GOO_TRACE_SCOPE("addLayer");
+        Layer layer;
+        if (!openLayer(path, fusion.size(), layers.isEmpty(), layer))
+            return false;
+        if (layers.isEmpty()) {
+            setFixedSize(layer.source.proxy().size());
+            fusion = QImage(layer.source.proxy().size(), QImage::Format_ARGB32_Premultiplied);
+            setFrame(&fusion);
+        }
+
+        const int k = layers.size();
+        layers.append(layer);
+        if (k % goo::LayersPerPlane == 0) {
+            planes.append(QImage(fusion.size(), QImage::Format_RGBA8888));
+            planes.last().fill(0);
+        }
+        if (k < 2) { // 128 = even mix of A and B
+            for (int y = 0; y < fusion.height(); ++y) {
+                uchar *w = planes[k / goo::LayersPerPlane].scanLine(y) + k % goo::LayersPerPlane;
+                for (int x = 0; x < fusion.width(); ++x)
+                    w[x * goo::LayersPerPlane] = 128;
             }
         }
+        rowBuf.resize(size_t(fusion.width()) * layers.size());
+        weightBuf.resize(size_t(fusion.width()) * layers.size());
 
-        update(); // trigger repaint
+        sourcesChanged();
+        return true;
     }
 
+    int layerCount() const { return layers.size(); }
 
-    void paintEvent(QPaintEvent*) override {
-        QPainter p(this);
-        p.drawImage(0, 0, fusion);
+    // Layer k at full resolution, waiting for it if it is still loading
+    const QImage &fullImage(int k) { return layers[k].source.full(); }
+
+    void waitForSources() {
+        for (int k = 0; k < layers.size(); ++k)
+            fullImage(k);
     }
+
+    QStringList layerPaths() const {
+        QStringList paths;
+        for (const Layer &l : layers)
+            paths << l.path;
+        return paths;
+    }
+    void setCurrentLayer(int k) { current = qBound(0, k, layers.size() - 1); }
+
+    void setRadius(int r) { radius = r; }
+    void setTool(ToolMode m) { mode = m; }
+    ToolMode tool() const { return mode; }
+
+    void setBlendMode(BlendMode m) {
+        blendMode = m;
+        sourcesChanged();
+    }
+
+    // Layers were added or multi-band turned on: everything is re-blended
+    void sourcesChanged() {
+        if (blendMode == Blend_MultiBand) {
+            QVector<QImage> placed;
+            for (int k = 0; k < layers.size(); ++k)
+                placed.append(placeLayer(proxyMapping(k)));
+            blender.setSources(placed);
+        }
+        updateFusion();
+    }
+
+    // Layer k's transform changed. Only its own footprint, before and after,
+    // is recomposited, and only its own pyramid is rebuilt.
+    void layerChanged(int k, const QRect &before) {
+        if (blendMode == Blend_MultiBand && blender.sourceCount() == layers.size()) {
+            blender.setSource(k, placeLayer(proxyMapping(k)));
+            updateFusion();
+            return;
+        }
+        updateFusion(before | layerBounds(k));
+    }
+
+    goo::LayerMapping proxyMapping(int k) const {
+        goo::LayerMapping m;
+        m.image = &layers[k].source.proxy();
+        m.toSource = layers[k].xf.toCanvas(layers[k].source.proxy().size()).inverted();
+        return m;
+    }
+
+    // Canvas pixels layer k covers
+    QRect layerBounds(int k) const {
+        const QImage &img = layers[k].source.proxy();
+        QRectF r = layers[k].xf.toCanvas(img.size()).mapRect(QRectF(img.rect()));
+        return r.toAlignedRect().adjusted(-1, -1, 1, 1).intersected(fusion.rect());
+    }
+
+    // A source positioned in canvas space, black where it doesn't cover
+    QImage placeLayer(const goo::LayerMapping &m) const {
+        QImage layer(fusion.size(), QImage::Format_ARGB32);
+        for (int y = 0; y < layer.height(); ++y)
+            goo::fetchLayerRow(m, 0, y, layer.width(), reinterpret_cast<QRgb*>(layer.scanLine(y)));
+        return layer;
+    }
+
+    // Re-blends 'area' of the fusion (the whole image if null)
+    void updateFusion(const QRect &area = QRect()) {
+        GOO_TRACE_SCOPE("updateFusion");
+        QRect r = area.isNull() ? fusion.rect() : area.intersected(fusion.rect());
+        if (r.isEmpty() || layers.isEmpty())
+            return;
+
+        if (blendMode == Blend_MultiBand && blender.isValid())
+            r = blender.update(planes, r, fusion);
+        else
+            blendLinear(r);
+
+        update(r); // trigger repaint
+    }
+
+    void blendLinear(const QRect &r) {
+        const int count = layers.size(), n = r.width();
+        goo::LayerMapping maps[goo::MaxLayers];
+        const QRgb *rows[goo::MaxLayers];
+        for (int k = 0; k < count; ++k) {
+            maps[k] = proxyMapping(k);
+            rows[k] = &rowBuf[size_t(k) * n];
+        }
+        for (int y = r.top(); y <= r.bottom(); ++y) {
+            // Every layer's row as it sits on the canvas, and its weights
+            for (int k = 0; k < count; ++k) {
+                goo::fetchLayerRow(maps[k], r.left(), y, n, &rowBuf[size_t(k) * n]);
+                const uchar *w = planes[k / goo::LayersPerPlane].constScanLine(y) + k % goo::LayersPerPlane; // planes align with fusion
+                for (int x = 0; x < n; ++x)
+                    weightBuf[size_t(x) * count + k] = w[(r.left() + x) * goo::LayersPerPlane];
+            }
+            goo::mixLayers(rows, weightBuf.data(), count, n, reinterpret_cast<QRgb*>(fusion.scanLine(y)) + r.left());
+        }
+    }
+
 QPoint lastPos;
     void mouseMoveEvent(QMouseEvent *e) override {
-        if ((mode == Tool_MoveA || mode == Tool_MoveB) && (e->buttons() & Qt::LeftButton)) {
+        if (mode == Tool_Move && (e->buttons() & Qt::LeftButton)) {
             QPoint delta = e->pos() - dragStart;
-            if (mode == Tool_MoveA)
-                offsetA = originalOffset + delta;
-            else
-                offsetB = originalOffset + delta;
+            QRect before = layerBounds(current);
+            layers[current].xf.translate = originalOffset + delta;
 
-            updateFusion(); // reblend with new offset
-            update();       // redraw
+            layerChanged(current, before); // reblend with new offset
         }
 
         if (mode == Tool_Smear && (e->buttons() & Qt::LeftButton)) {
@@ -117,122 +590,441 @@ QPoint lastPos;
             if (delta.manhattanLength() < 1)
                 return;
 
-            QPainter p(&mask);
-            p.setRenderHint(QPainter::SmoothPixmapTransform);
-            p.setRenderHint(QPainter::Antialiasing);
-
-            int patchSize = radius * 2;
-            QRect area(lastPos - QPoint(radius, radius), QSize(patchSize, patchSize));
-            QImage patch = mask.copy(area);
-
-            QPointF offset = delta; // smear direction
-            QRectF targetRect = QRectF(area).translated(offset.x(), offset.y());
-
-
-            // Use semi-transparent blending to create a dragging effect
-            p.setOpacity(0.9); // blend rather than hard overwrite
-            p.drawImage(targetRect, patch);
-
-            updateFusion();
+            GOO_TRACE_SCOPE("smear");
+            history.touch(planes, brushRect(lastPos) | brushRect(e->pos()));
+            QRect dirty;
+            for (QImage &plane : planes)
+                dirty |= smearer.apply(plane, lastPos, e->pos(), radius, 0.9f);
+            updateFusion(dirty);
             lastPos = e->pos();
+            return;
         }
 applyBrush(e->pos());
 
     }
 
     void mousePressEvent(QMouseEvent *e) override {
-        if (mode == Tool_MoveA || mode == Tool_MoveB) {
+        if (mode == Tool_Move) {
             dragStart = e->pos();
-            originalOffset = (mode == Tool_MoveA) ? offsetA : offsetB;
+            originalOffset = layers[current].xf.translate;
         }
+        lastPos = e->pos();
 
         applyBrush(e->pos());
     }
 
+    // With the move tool, the wheel scales the layer and Shift+wheel rotates it
+    void wheelEvent(QWheelEvent *e) override {
+        if (mode != Tool_Move)
+            return;
+        goo::LayerTransform &xf = layers[current].xf;
+        QRect before = layerBounds(current);
+        const double steps = e->angleDelta().y() / 120.0;
+        if (e->modifiers() & Qt::ShiftModifier)
+            xf.rotation += steps;
+        else
+            xf.scale = qBound(0.1, xf.scale * qPow(1.02, steps), 10.0);
+        layerChanged(current, before);
+    }
+
+    void mouseReleaseEvent(QMouseEvent *) override {
+        history.commit(planes); // one undo step per stroke
+    }
+
+    // Everything a dab at 'pos' can write to
+    QRect brushRect(QPoint pos) const {
+        int r = qCeil(radius) + 1;
+        return QRect(pos - QPoint(r, r), pos + QPoint(r, r));
+    }
+
+    void undo() {
+        QRect r = history.undo(planes);
+        if (!r.isNull())
+            updateFusion(r);
+    }
+
+    void redo() {
+        QRect r = history.redo(planes);
+        if (!r.isNull())
+            updateFusion(r);
+    }
+
     void applyBrush(QPoint pos) {
+        GOO_TRACE_SCOPE("brush");
         if (mode == Tool_Smooth) {
-            int size = radius * 2;
-            QRect area(pos - QPoint(radius, radius), QSize(size, size));
+            history.touch(planes, brushRect(pos));
+            QRect dirty;
+            for (QImage &plane : planes)
+                dirty |= smoother.apply(plane, pos, radius, 0.7f); // soft blend
+            updateFusion(dirty);
+            return;
+        }
+        if (mode != Tool_Paint)
+            return;
 
-            QImage patch = mask.copy(area);
-            QImage blurred = patch.scaled(radius, radius, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
-                                  .scaled(size, size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        history.touch(planes, brushRect(pos));
+        updateFusion(goo::paintWeights(planes, current, layers.size(), pos, radius));
+    }
 
-            QPainter p(&mask);
-            p.setOpacity(0.7); // soft blend
-            p.drawImage(area.topLeft(), blurred);
-            updateFusion();
-            return;
+    void flipLayer(bool horiz) {
+        goo::LayerTransform &xf = layers[current].xf;
+        if (horiz)
+            xf.flipH = !xf.flipH;
+        else
+            xf.flipV = !xf.flipV;
+        // Morph points stay on the features they mark
+        if (current < 2) {
+            const QSizeF size = layers[current].source.proxy().size();
+            for (QPointF &p : current ? featuresB : featuresA)
+                p = horiz ? QPointF(size.width() - p.x(), p.y()) : QPointF(p.x(), size.height() - p.y());
         }
+        layerChanged(current, layerBounds(current));
+    }
 
+    const goo::LayerTransform &transform(int k) const { return layers[k].xf; }
 
-        QPainter p(&mask);
+    // Moves, turns and scales layer k onto layer A in one step
+    bool autoAlign(int k) {
+        if (k <= 0 || k >= layers.size())
+            return false;
+        GOO_TRACE_SCOPE("autoAlign");
+        const QRect before = layerBounds(k);
+        goo::LayerAligner aligner(proxyMapping(0), fusion.size());
+        layers[k].xf = aligner.align(layers[k].source.proxy(), layers[k].xf);
+        layerChanged(k, before);
+        return true;
+    }
 
-        QRadialGradient g(pos, radius);
-        QColor existing = mask.pixelColor(pos);
+    // Renders the composite at the first layer's full resolution. The mask
+    // and transforms are edited on the proxy, so they are mapped through
+    // continuous coordinates and resampled. Bands of rows are split into
+    // tiles and blended on all cores, then streamed to 'path' before the next
+    // band starts. The full-resolution blend is always the linear one.
+    bool exportFullResolution(const QString &path) {
+        GOO_TRACE_SCOPE("exportFullResolution");
+        waitForSources();
+        const QSize size = fullImage(0).size();
+        const double sx = double(size.width()) / fusion.width();
+        const double sy = double(size.height()) / fusion.height();
 
-        if (mode == Tool_PaintA) {
-            g.setColorAt(0.0, QColor(0, 0, 0));
-        } else if (mode == Tool_PaintB) {
-            g.setColorAt(0.0, QColor(255, 255, 255));
-        } else {
-            return;
+        // Full canvas -> proxy canvas -> proxy source -> full source
+        const QTransform toProxy = QTransform::fromScale(1 / sx, 1 / sy);
+        QVector<goo::LayerMapping> maps;
+        for (int k = 0; k < layers.size(); ++k) {
+            const QImage &full = fullImage(k), &proxy = layers[k].source.proxy();
+            goo::LayerMapping m;
+            m.image = &full;
+            m.toSource = toProxy * proxyMapping(k).toSource *
+                         QTransform::fromScale(double(full.width()) / proxy.width(),
+                                               double(full.height()) / proxy.height());
+            maps.append(m);
         }
-        g.setColorAt(1.0, existing);  // feather from existing value
 
-        p.setCompositionMode(QPainter::CompositionMode_SourceOver);
-        p.setBrush(g);
-        p.setPen(Qt::NoPen);
-      //  p.drawEllipse(pos, radius, radius);
-        p.drawEllipse(QPointF(pos), radius, radius);
+        RowStreamWriter writer;
+        if (!writer.open(path, size.width(), size.height()))
+            return false;
 
-        updateFusion();
+        const int stride = size.width() * 3;
+        std::vector<uchar> band(size_t(stride) * ExportBandRows);
+        QVector<QRect> tiles;
+        for (int y = 0; y < size.height(); y += ExportBandRows) {
+            const int rows = qMin(ExportBandRows, size.height() - y);
+            tiles.clear();
+            for (int x = 0; x < size.width(); x += ExportTileWidth)
+                tiles.append(QRect(x, y, qMin(ExportTileWidth, size.width() - x), rows));
+
+            QtConcurrent::blockingMap(tiles, [&](const QRect &tile) {
+                goo::compositeTile(maps, planes, toProxy, tile, band.data() + size_t(tile.left()) * 3, stride);
+            });
+            if (!writer.writeRows(band.data(), qint64(stride) * rows))
+                return false;
+        }
+        writer.close();
+        return true;
     }
 
-    void flipImageA(bool horiz) {
-        QTransform t;
-        t.scale(horiz ? -1 : 1, horiz ? 1 : -1);
-        imgA = imgA.transformed(t, Qt::SmoothTransformation);
-        updateFusion();
+    // Matching points are placed alternately on A and B; point i on one
+    // face pairs with point i on the other.
+    void addFeature(bool onB, QPoint pos) {
+        (onB ? featuresB : featuresA).append(QPointF(pos) + QPointF(0.5, 0.5));
     }
 
-    void flipImageB(bool horiz) {
-        QTransform t;
-        t.scale(horiz ? -1 : 1, horiz ? 1 : -1);
-        imgB = imgB.transformed(t, Qt::SmoothTransformation);
-        updateFusion();
+    void clearFeatures() {
+        featuresA.clear();
+        featuresB.clear();
+    }
+
+    const QVector<QPointF> &features(bool onB) const { return onB ? featuresB : featuresA; }
+
+    // Renders an A -> B morph of the first two layers from their
+    // full-resolution sources into 'dir' as morph_0000.png, morph_0001.png,
+    // ... Frames are at most 1920 pixels on a side, with A's aspect. Both
+    // faces are flipped as they are on the canvas.
+    bool renderMorph(const QString &dir, int frames) {
+        if (layers.size() < 2 || featuresA.size() != featuresB.size())
+            return false;
+        waitForSources();
+        const goo::LayerTransform &xfA = layers[0].xf, &xfB = layers[1].xf;
+        const QImage fullA = fullImage(0).mirrored(xfA.flipH, xfA.flipV);
+        const QImage fullB = fullImage(1).mirrored(xfB.flipH, xfB.flipV);
+        const QImage &imgA = layers[0].source.proxy(), &imgB = layers[1].source.proxy();
+
+        goo::MorphSequence seq;
+        seq.a = fullA;
+        seq.b = fullB;
+        seq.frames = frames;
+        seq.frameSize = fullA.size().scaled(QSize(1920, 1920).boundedTo(fullA.size()), Qt::KeepAspectRatio);
+        seq.pattern = dir + "/morph_%1.png";
+
+        const QPointF ka(double(fullA.width()) / imgA.width(), double(fullA.height()) / imgA.height());
+        const QPointF kb(double(fullB.width()) / imgB.width(), double(fullB.height()) / imgB.height());
+        for (int i = 0; i < featuresA.size(); ++i) {
+            seq.ptsA.append(QPointF(featuresA[i].x() * ka.x(), featuresA[i].y() * ka.y()));
+            seq.ptsB.append(QPointF(featuresB[i].x() * kb.x(), featuresB[i].y() * kb.y()));
+        }
+        // Pin the corners so the mesh covers every frame
+        seq.ptsA << QPointF(0, 0) << QPointF(fullA.width(), 0)
+                 << QPointF(0, fullA.height()) << QPointF(fullA.width(), fullA.height());
+        seq.ptsB << QPointF(0, 0) << QPointF(fullB.width(), 0)
+                 << QPointF(0, fullB.height()) << QPointF(fullB.width(), fullB.height());
+        return goo::renderMorphSequence(seq);
+    }
+
+    // Sources are stored by path, the weight planes as tiles and the undo
+    // stack as it is, still compressed.
+    bool saveSession(const QString &path) const {
+        GOO_TRACE_SCOPE("saveSession");
+        QMap<QString, QString> meta;
+        meta["app"] = "fusion";
+        meta["layers"] = QString::number(layers.size());
+        meta["blend"] = (blendMode == Blend_MultiBand) ? "multiband" : "linear";
+        meta["current"] = QString::number(current);
+        meta["radius"] = QString::number(radius);
+        for (int k = 0; k < layers.size(); ++k) {
+            const QString key = QString("layer%1.").arg(k);
+            const goo::LayerTransform &xf = layers[k].xf;
+            meta[key + "path"] = layers[k].path;
+            meta[key + "flipH"] = QString::number(int(xf.flipH));
+            meta[key + "flipV"] = QString::number(int(xf.flipV));
+            meta[key + "rotation"] = QString::number(xf.rotation, 'g', 17);
+            meta[key + "scale"] = QString::number(xf.scale, 'g', 17);
+            meta[key + "x"] = QString::number(xf.translate.x(), 'g', 17);
+            meta[key + "y"] = QString::number(xf.translate.y(), 'g', 17);
+        }
+        auto points = [](const QVector<QPointF> &pts) {
+            QStringList l;
+            for (const QPointF &p : pts)
+                l << QString("%1,%2").arg(p.x()).arg(p.y());
+            return l.join(";");
+        };
+        meta["featuresA"] = points(featuresA);
+        meta["featuresB"] = points(featuresB);
+
+        goo::SessionWriter writer(path);
+        if (!writer.open())
+            return false;
+        writer.addMeta(meta);
+        for (int i = 0; i < planes.size(); ++i)
+            writer.addImage(i, planes[i], 64);
+        writer.addBlob(goo::SessionTagHistory, 0, history.save());
+        return writer.finish();
+    }
+
+    bool loadSession(const QString &path) {
+        GOO_TRACE_SCOPE("loadSession");
+        goo::SessionReader reader;
+        if (!reader.open(path))
+            return false;
+        const QMap<QString, QString> meta = reader.meta();
+        const int count = meta.value("layers").toInt();
+        if (meta.value("app") != "fusion" || count < 1 || count > goo::MaxLayers)
+            return false;
+
+        // Everything is built on the side and swapped in only once all of it
+        // has loaded, so a bad file leaves the canvas as it was
+        QVector<QImage> newPlanes;
+        for (int i = 0; i * goo::LayersPerPlane < count; ++i) {
+            QImage plane = reader.allocImage(i);
+            if (plane.format() != QImage::Format_RGBA8888 || (i > 0 && plane.size() != newPlanes.first().size())
+                || !reader.readImage(i, plane)) // the whole mask is always on screen
+                return false;
+            newPlanes.append(plane);
+        }
+        const QSize canvasSize = newPlanes.first().size();
+        MaskHistory newHistory;
+        if (!newHistory.restore(reader.blob(goo::SessionTagHistory), newPlanes))
+            return false;
+
+        QVector<Layer> newLayers;
+        for (int k = 0; k < count; ++k) {
+            const QString key = QString("layer%1.").arg(k);
+            Layer layer;
+            if (!openLayer(meta.value(key + "path"), canvasSize, k == 0, layer))
+                return false;
+            goo::LayerTransform &xf = layer.xf;
+            xf.flipH = meta.value(key + "flipH").toInt() != 0;
+            xf.flipV = meta.value(key + "flipV").toInt() != 0;
+            xf.rotation = meta.value(key + "rotation").toDouble();
+            xf.scale = meta.value(key + "scale", "1").toDouble();
+            xf.translate = QPointF(meta.value(key + "x").toDouble(), meta.value(key + "y").toDouble());
+            if (!(xf.scale > 0) || !qIsFinite(xf.scale) || !qIsFinite(xf.rotation)
+                || !qIsFinite(xf.translate.x()) || !qIsFinite(xf.translate.y()))
+                return false;
+            newLayers.append(layer);
+        }
+        if (newLayers.first().source.proxy().size() != canvasSize)
+            return false;
+
+        layers = newLayers;
+        planes = newPlanes;
+        history = newHistory;
+        fusion = QImage(canvasSize, QImage::Format_ARGB32_Premultiplied);
+        setFixedSize(canvasSize);
+        setFrame(&fusion);
+        rowBuf.resize(size_t(fusion.width()) * layers.size());
+        weightBuf.resize(size_t(fusion.width()) * layers.size());
+
+        auto points = [](const QString &text) {
+            QVector<QPointF> pts;
+            for (const QString &p : text.split(";")) {
+                QStringList xy = p.split(",");
+                if (xy.size() == 2)
+                    pts.append(QPointF(xy[0].toDouble(), xy[1].toDouble()));
+            }
+            return pts;
+        };
+        featuresA = points(meta.value("featuresA"));
+        featuresB = points(meta.value("featuresB"));
+        radius = meta.value("radius", "50").toFloat();
+        setCurrentLayer(meta.value("current").toInt());
+        blendMode = (meta.value("blend") == "multiband") ? Blend_MultiBand : Blend_Linear;
+        sourcesChanged();
+        return true;
     }
 
-    QImage getImageA() const { return imgA; }
-    QImage getImageB() const { return imgB; }
-    QImage getFusion() const { return fusion; }
+    int currentLayer() const { return current; }
+    BlendMode blend() const { return blendMode; }
+
+    // Layer k's proxy, facing the way it does on the canvas
+    QImage layerImage(int k) const {
+        const Layer l = layers.value(k);
+        return l.source.proxy().mirrored(l.xf.flipH, l.xf.flipV);
+    }
+    const QImage &getFusion() const { return fusion; }
+};
+
+// Headless mode: QFusionRoom --batch <manifest> [--threads N]
+static int runBatch(QCoreApplication &app) {
+    QTextStream out(stdout), err(stderr);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Blend A/B face pairs listed in a manifest.");
+    parser.addHelpOption();
+    QCommandLineOption batchOption("batch", "Manifest of jobs, one per line.", "manifest");
+    QCommandLineOption threadsOption("threads", "Worker threads (default: all cores).", "n");
+    parser.addOption(batchOption);
+    parser.addOption(threadsOption);
+    parser.process(app);
+
+    const int threads = parser.isSet(threadsOption) ? parser.value(threadsOption).toInt() : 0;
+    return goo::runBatch(parser.value(batchOption), threads, out, err);
+}
+
+// Source view that also shows, and takes clicks for, the morph points
+class FeatureView : public goo::FrameView {
+    QImage image;
+
+public:
+    const QVector<QPointF> *points = nullptr;
+    std::function<void(QPoint)> clicked;
+
+    // Sources are never written once loaded, so holding one copies nothing
+    void setImage(const QImage &img) {
+        image = img;
+        setFrame(&image);
+    }
+
+protected:
+    void mousePressEvent(QMouseEvent *e) override {
+        if (clicked && e->button() == Qt::LeftButton)
+            clicked(e->pos());
+    }
+
+    void paintEvent(QPaintEvent *e) override {
+        goo::FrameView::paintEvent(e);
+        if (!points)
+            return;
+        QPainter p(this);
+        p.setRenderHint(QPainter::Antialiasing);
+        for (int i = 0; i < points->size(); ++i) {
+            QPointF c = points->at(i);
+            p.setPen(Qt::black);
+            p.setBrush(Qt::yellow);
+            p.drawEllipse(c, 3.5, 3.5);
+            p.setPen(Qt::yellow);
+            p.drawText(c + QPointF(5, -5), QString::number(i + 1));
+        }
+    }
 };
 
 int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (QString(argv[i]) == "--batch") {
+            QCoreApplication app(argc, argv);
+            goo::trace::startFromEnvironment();
+            return runBatch(app);
+        }
+    }
+
     QApplication app(argc, argv);
+    goo::trace::startFromEnvironment();
 
-    QString pathA = QFileDialog::getOpenFileName(nullptr, "Select Face A");
-    QString pathB = QFileDialog::getOpenFileName(nullptr, "Select Face B");
-    if (pathA.isEmpty() || pathB.isEmpty()) return 0;
+    QString pathA = QFileDialog::getOpenFileName(nullptr, "Select Face A (or a .fusion session)");
+    if (pathA.isEmpty()) return 0;
+
+    // Load fusion canvas
+    FusionCanvas *canvas;
+    if (pathA.endsWith(".fusion", Qt::CaseInsensitive)) {
+        canvas = new FusionCanvas(QStringList());
+        if (!canvas->loadSession(pathA)) {
+            QMessageBox::warning(nullptr, "Open Session", "Could not open " + pathA);
+            return 0;
+        }
+    } else {
+        QString pathB = QFileDialog::getOpenFileName(nullptr, "Select Face B");
+        if (pathB.isEmpty()) return 0;
+        canvas = new FusionCanvas(QStringList());
+        for (const QString &path : QStringList() << pathA << pathB) {
+            if (!canvas->addLayer(path)) {
+                QMessageBox::warning(nullptr, "Open Images", "Could not load " + path);
+                return 0;
+            }
+        }
+    }
 
     QWidget *window = new QWidget;
     QVBoxLayout *mainLayout = new QVBoxLayout(window);
     QHBoxLayout *topLayout = new QHBoxLayout;
     QHBoxLayout *controls = new QHBoxLayout;
 
-    // Load fusion canvas
-    FusionCanvas *canvas = new FusionCanvas(pathA, pathB);
-
     // Views for A, Fusion, B
-    QLabel *viewA = new QLabel;
-    QLabel *viewB = new QLabel;
-    QLabel *viewF = new QLabel;
-
-    viewA->setPixmap(QPixmap::fromImage(canvas->getImageA()));
-    viewB->setPixmap(QPixmap::fromImage(canvas->getImageB()));
-    viewF->setPixmap(QPixmap::fromImage(canvas->getFusion()));
+    FeatureView *viewA = new FeatureView;
+    FeatureView *viewB = new FeatureView;
 
-    viewF->setPixmap(QPixmap::fromImage(canvas->getFusion()));
+    viewA->points = &canvas->features(false);
+    viewB->points = &canvas->features(true);
+    viewA->clicked = [=](QPoint pos) {
+        if (canvas->tool() == Tool_MorphPoints) {
+            canvas->addFeature(false, pos);
+            viewA->update();
+        }
+    };
+    viewB->clicked = [=](QPoint pos) {
+        if (canvas->tool() == Tool_MorphPoints) {
+            canvas->addFeature(true, pos);
+            viewB->update();
+        }
+    };
 
     topLayout->addWidget(viewA);
     topLayout->addWidget(canvas);
@@ -246,47 +1038,173 @@ int main(int argc, char *argv[]) {
 
     // Tool selection
     QButtonGroup *tools = new QButtonGroup;
-    QRadioButton *paintA = new QRadioButton("Paint A");
-    QRadioButton *paintB = new QRadioButton("Paint B");
+    QRadioButton *paint = new QRadioButton("Paint");
     QRadioButton *smear = new QRadioButton("Smear");
     QRadioButton *smooth = new QRadioButton("Smooth");
-    QRadioButton *movea = new QRadioButton("Move A");
-    QRadioButton *moveb = new QRadioButton("Move B");
-    paintA->setChecked(true);
-    tools->addButton(paintA, Tool_PaintA);
-    tools->addButton(paintB, Tool_PaintB);
+    QRadioButton *move = new QRadioButton("Move");
+    QRadioButton *morphPts = new QRadioButton("Morph Points");
+    paint->setChecked(true);
+    tools->addButton(paint, Tool_Paint);
     tools->addButton(smear, Tool_Smear);
     tools->addButton(smooth, Tool_Smooth);
-    tools->addButton(movea, Tool_MoveA);
-    tools->addButton(moveb, Tool_MoveB);
+    tools->addButton(move, Tool_Move);
+    tools->addButton(morphPts, Tool_MorphPoints);
+
+    // Layer that Paint, Move and Flip work on
+    QComboBox *layerBox = new QComboBox;
+    QObject::connect(layerBox, QOverload<int>::of(&QComboBox::currentIndexChanged), canvas, &FusionCanvas::setCurrentLayer);
+
+    // Layer list and source views, after the canvas gets new layers
+    auto refreshLayers = [=]() {
+        const QStringList paths = canvas->layerPaths();
+        layerBox->blockSignals(true);
+        layerBox->clear();
+        for (int k = 0; k < paths.size(); ++k) {
+            QString name = (k == 0) ? "A" : (k == 1) ? "B" : QString::number(k + 1);
+            layerBox->addItem(name + ": " + QFileInfo(paths[k]).fileName());
+        }
+        layerBox->setCurrentIndex(canvas->currentLayer());
+        layerBox->blockSignals(false);
+        viewA->setImage(canvas->layerImage(0));
+        viewB->setImage(canvas->layerImage(1));
+    };
+    refreshLayers();
+
+    QPushButton *addLayerBtn = new QPushButton("Add Layer...");
+    QObject::connect(addLayerBtn, &QPushButton::clicked, [=]() {
+        if (canvas->layerCount() >= goo::MaxLayers) {
+            QMessageBox::information(window, "Add Layer", QString("At most %1 layers.").arg(goo::MaxLayers));
+            return;
+        }
+        QString path = QFileDialog::getOpenFileName(window, "Add Face");
+        if (path.isEmpty())
+            return;
+        if (!canvas->addLayer(path)) {
+            QMessageBox::warning(window, "Add Layer", "Could not load " + path);
+            return;
+        }
+        canvas->setCurrentLayer(canvas->layerCount() - 1);
+        refreshLayers();
+    });
+
 
     QObject::connect(tools, QOverload<int>::of(&QButtonGroup::buttonClicked), [=](int id) {
         canvas->setTool(static_cast<ToolMode>(id));
     });
 
-    // Flip buttons
-    QPushButton *flipA = new QPushButton("Flip A");
-    QPushButton *flipB = new QPushButton("Flip B");
+    QPushButton *flip = new QPushButton("Flip");
+
+    // Aligns the current layer to A, or B when A is current
+    QPushButton *alignBtn = new QPushButton("Auto Align");
+    QObject::connect(alignBtn, &QPushButton::clicked, [=]() {
+        QGuiApplication::setOverrideCursor(Qt::WaitCursor);
+        canvas->autoAlign(qMax(1, canvas->currentLayer()));
+        QGuiApplication::restoreOverrideCursor();
+    });
+
+    QPushButton *undoBtn = new QPushButton("Undo");
+    QPushButton *redoBtn = new QPushButton("Redo");
+    QObject::connect(undoBtn, &QPushButton::clicked, canvas, &FusionCanvas::undo);
+    QObject::connect(redoBtn, &QPushButton::clicked, canvas, &FusionCanvas::redo);
+    QObject::connect(new QShortcut(QKeySequence::Undo, window), &QShortcut::activated, canvas, &FusionCanvas::undo);
+    QObject::connect(new QShortcut(QKeySequence::Redo, window), &QShortcut::activated, canvas, &FusionCanvas::redo);
+    goo::trace::installToggleShortcut(window);
+
+    QPushButton *exportBtn = new QPushButton("Export...");
+    QObject::connect(exportBtn, &QPushButton::clicked, [=]() {
+        QString path = QFileDialog::getSaveFileName(window, "Export Full Resolution", "fusion.tif",
+                                                    "TIFF (*.tif *.tiff);;PPM (*.ppm)");
+        if (path.isEmpty())
+            return;
+        QGuiApplication::setOverrideCursor(Qt::WaitCursor);
+        bool ok = canvas->exportFullResolution(path);
+        QGuiApplication::restoreOverrideCursor();
+        if (!ok)
+            QMessageBox::warning(window, "Export", "Could not write " + path);
+    });
 
-    QObject::connect(flipA, &QPushButton::clicked, [=]() {
-        canvas->flipImageA(true);
-        viewA->setPixmap(QPixmap::fromImage(canvas->getImageA()));
+    QPushButton *clearPts = new QPushButton("Clear Points");
+    QObject::connect(clearPts, &QPushButton::clicked, [=]() {
+        canvas->clearFeatures();
+        viewA->update();
+        viewB->update();
     });
-    QObject::connect(flipB, &QPushButton::clicked, [=]() {
-        canvas->flipImageB(true);
-        viewB->setPixmap(QPixmap::fromImage(canvas->getImageB()));
+
+    QPushButton *morphBtn = new QPushButton("Render Morph...");
+    QObject::connect(morphBtn, &QPushButton::clicked, [=]() {
+        if (canvas->features(false).size() != canvas->features(true).size()) {
+            QMessageBox::warning(window, "Morph", "Place the same number of points on A and B.");
+            return;
+        }
+        bool ok = false;
+        int frames = QInputDialog::getInt(window, "Render Morph", "Frames", 30, 2, 10000, 1, &ok);
+        if (!ok)
+            return;
+        QString dir = QFileDialog::getExistingDirectory(window, "Morph Frames Folder");
+        if (dir.isEmpty())
+            return;
+        QGuiApplication::setOverrideCursor(Qt::WaitCursor);
+        ok = canvas->renderMorph(dir, frames);
+        QGuiApplication::restoreOverrideCursor();
+        if (!ok)
+            QMessageBox::warning(window, "Morph", "Could not write the frames to " + dir);
+    });
+
+    // Seamless multi-band blending instead of a straight mix through the mask
+    QCheckBox *multiBand = new QCheckBox("Multi-band");
+    QObject::connect(multiBand, &QCheckBox::toggled, [=](bool on) {
+        canvas->setBlendMode(on ? Blend_MultiBand : Blend_Linear);
+    });
+    multiBand->setChecked(canvas->blend() == Blend_MultiBand);
+
+    QPushButton *saveBtn = new QPushButton("Save Session...");
+    QObject::connect(saveBtn, &QPushButton::clicked, [=]() {
+        QString path = QFileDialog::getSaveFileName(window, "Save Session", "untitled.fusion", "Fusion sessions (*.fusion)");
+        if (!path.isEmpty() && !canvas->saveSession(path))
+            QMessageBox::warning(window, "Save Session", "Could not write " + path);
+    });
+
+    QPushButton *openBtn = new QPushButton("Open Session...");
+    QObject::connect(openBtn, &QPushButton::clicked, [=]() {
+        QString path = QFileDialog::getOpenFileName(window, "Open Session", QString(), "Fusion sessions (*.fusion)");
+        if (path.isEmpty())
+            return;
+        if (!canvas->loadSession(path)) {
+            QMessageBox::warning(window, "Open Session", "Could not open " + path + " or one of its sources");
+            return;
+        }
+        refreshLayers();
+        multiBand->setChecked(canvas->blend() == Blend_MultiBand);
+        viewA->update();
+        viewB->update();
+    });
+
+    QObject::connect(flip, &QPushButton::clicked, [=]() {
+        canvas->flipLayer(true);
+        refreshLayers();
+        viewA->update();
+        viewB->update();
     });
 
-    controls->addWidget(paintA);
-    controls->addWidget(paintB);
+    controls->addWidget(paint);
     controls->addWidget(smear);
     controls->addWidget(smooth);
-    controls->addWidget(movea);
-    controls->addWidget(moveb);
+    controls->addWidget(move);
+    controls->addWidget(morphPts);
     controls->addWidget(new QLabel("Brush Radius"));
     controls->addWidget(radiusSlider);
-    controls->addWidget(flipA);
-    controls->addWidget(flipB);
+    controls->addWidget(layerBox);
+    controls->addWidget(addLayerBtn);
+    controls->addWidget(flip);
+    controls->addWidget(alignBtn);
+    controls->addWidget(multiBand);
+    controls->addWidget(undoBtn);
+    controls->addWidget(redoBtn);
+    controls->addWidget(exportBtn);
+    controls->addWidget(saveBtn);
+    controls->addWidget(openBtn);
+    controls->addWidget(clearPts);
+    controls->addWidget(morphBtn);
 
     mainLayout->addLayout(topLayout);
     mainLayout->addLayout(controls);
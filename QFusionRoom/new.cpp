@@ -14,7 +14,13 @@
 #include <QGroupBox>
 #include <QTransform>
 #include <QObject>
+#include <QToolTip>
+#include <QCheckBox>
+#include <QtMath>
 #include <qdebug.h>
+#include <cstring>
+#include <functional>
+#include <vector>
 
 enum ToolMode {
     Tool_PaintA,
@@ -62,6 +68,76 @@ private:
 
 
 
+// Clone stamp: copies pixels from a source image into a destination layer
+// through a round, feathered dab. The feather weights for the current radius
+// are built once and reused, and dabs work directly on scanlines.
+class CloneStamp {
+    int stampRadius = -1;
+    std::vector<uchar> stamp;  // (2r+1)² feather weights, 0–255
+    std::vector<QRgb> scratch; // source patch when cloning within one image
+
+    void buildStamp(int r) {
+        const int size = 2 * r + 1;
+        stamp.resize(size_t(size) * size);
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                float dist = std::sqrt(float((x - r) * (x - r) + (y - r) * (y - r)));
+                float feather = qMax(0.0f, 1.0f - dist / r);
+                stamp[size_t(y) * size + x] = uchar(qRound(feather * feather * 255)); // feathering curve
+            }
+        }
+        stampRadius = r;
+    }
+
+public:
+    // Stamps a dab centred on 'center' (in dst coordinates) with the pixels of
+    // 'src' at 'center + sourceOffset'. src and dst may be the same image.
+    // Returns the rect of dst that changed.
+    QRect dab(const QImage &src, QImage &dst, QPoint center, QPoint sourceOffset, int radius) {
+        const int r = qMax(1, radius);
+        if (r != stampRadius)
+            buildStamp(r);
+
+        QRect area = QRect(center - QPoint(r, r), center + QPoint(r, r)).intersected(dst.rect());
+        area &= src.rect().translated(-sourceOffset);
+        if (area.isEmpty())
+            return QRect();
+
+        // Cloning inside one image must not read pixels this dab already wrote
+        const bool sameImage = (&src == &dst);
+        const int w = area.width();
+        if (sameImage) {
+            scratch.resize(size_t(w) * area.height());
+            for (int y = area.top(); y <= area.bottom(); ++y) {
+                const QRgb *s = reinterpret_cast<const QRgb*>(src.constScanLine(y + sourceOffset.y()));
+                memcpy(&scratch[size_t(y - area.top()) * w], s + area.left() + sourceOffset.x(), w * sizeof(QRgb));
+            }
+        }
+
+        const int size = 2 * r + 1;
+        for (int y = area.top(); y <= area.bottom(); ++y) {
+            const uchar *a = &stamp[size_t(y - center.y() + r) * size + (area.left() - center.x() + r)];
+            QRgb *d = reinterpret_cast<QRgb*>(dst.scanLine(y)) + area.left();
+            const QRgb *s = sameImage
+                    ? &scratch[size_t(y - area.top()) * w]
+                    : reinterpret_cast<const QRgb*>(src.constScanLine(y + sourceOffset.y())) + area.left() + sourceOffset.x();
+
+            for (int x = 0; x < w; ++x) {
+                const int k = a[x];
+                if (!k)
+                    continue;
+                const QRgb sc = s[x], dc = d[x];
+                d[x] = qRgba((qRed(dc)   * (255 - k) + qRed(sc)   * k + 127) / 255,
+                             (qGreen(dc) * (255 - k) + qGreen(sc) * k + 127) / 255,
+                             (qBlue(dc)  * (255 - k) + qBlue(sc)  * k + 127) / 255,
+                             (qAlpha(dc) * (255 - k) + qAlpha(sc) * k + 127) / 255);
+            }
+        }
+        return area;
+    }
+};
+
+
 class FusionCanvas : public QWidget {
     QImage imgA, imgB, mask, fusion;
     float radius = 50.0f;
@@ -69,6 +145,11 @@ class FusionCanvas : public QWidget {
     QPoint offsetB = QPoint(0, 0);
     ToolMode mode = Tool_PaintA;
 
+    CloneStamp cloner;
+    QPoint cloneOffset;          // source minus destination, in layer pixels
+    bool cloneOffsetSet = false;
+    bool cloneAligned = true;    // keep the offset between strokes
+
 public:
     FusionCanvas(const QString &pathA, const QString &pathB, QWidget *parent = nullptr) : QWidget(parent) {
         imgA.load(pathA);
@@ -81,51 +162,46 @@ public:
         setFixedSize(imgA.size());
         mask = QImage(imgA.size(), QImage::Format_Grayscale8);
         mask.fill(128); // 128 = even mix of A and B
+        fusion = QImage(imgA.size(), QImage::Format_ARGB32);
 
         updateFusion();
     }
 
+    // Called after a stroke changes A or B themselves
+    std::function<void()> layersChanged;
+
     void setRadius(int r) { radius = r; }
     void setTool(ToolMode m) { mode = m; }
-
-    void updateFusion() {
-        fusion = QImage(imgA.size(), QImage::Format_ARGB32);
-
-        for (int y = 0; y < fusion.height(); ++y) {
-            for (int x = 0; x < fusion.width(); ++x) {
-                // Map (x, y) to source positions in A and B
-                QPoint pt(x, y);
-                QPoint ptA = pt - offsetA;
-                QPoint ptB = pt - offsetB;
-
-                QColor cA = Qt::black;
-                QColor cB = Qt::black;
-
-                // Sample A if inside bounds
-                if (imgA.rect().contains(ptA)) {
-                    cA = imgA.pixelColor(ptA);
-                }
-
-                // Sample B if inside bounds
-                if (imgB.rect().contains(ptB)) {
-                    cB = imgB.pixelColor(ptB);
-                }
-
-                // Mask always aligns with fusion
-                int alpha = mask.pixelColor(x, y).red(); // 0–255
-                float blend = alpha / 255.0f;
-
-                QColor mix = QColor::fromRgb(
-                    cA.red()   * (1 - blend) + cB.red()   * blend,
-                    cA.green() * (1 - blend) + cB.green() * blend,
-                    cA.blue()  * (1 - blend) + cB.blue()  * blend
-                );
-
-                fusion.setPixelColor(x, y, mix);
+    void setCloneAligned(bool on) { cloneAligned = on; }
+
+    // Re-blends 'area' of the fusion (the whole image if null)
+    void updateFusion(const QRect &area = QRect()) {
+        QRect r = area.isNull() ? fusion.rect() : area.intersected(fusion.rect());
+        const QRgb black = qRgb(0, 0, 0);
+
+        for (int y = r.top(); y <= r.bottom(); ++y) {
+            // Map the row to source rows in A and B
+            int ya = y - offsetA.y();
+            int yb = y - offsetB.y();
+            const QRgb *rowA = (ya >= 0 && ya < imgA.height()) ? reinterpret_cast<const QRgb*>(imgA.constScanLine(ya)) : nullptr;
+            const QRgb *rowB = (yb >= 0 && yb < imgB.height()) ? reinterpret_cast<const QRgb*>(imgB.constScanLine(yb)) : nullptr;
+            const uchar *m = mask.constScanLine(y); // mask always aligns with fusion
+            QRgb *out = reinterpret_cast<QRgb*>(fusion.scanLine(y));
+
+            for (int x = r.left(); x <= r.right(); ++x) {
+                int xa = x - offsetA.x();
+                int xb = x - offsetB.x();
+                QRgb cA = (rowA && xa >= 0 && xa < imgA.width()) ? rowA[xa] : black;
+                QRgb cB = (rowB && xb >= 0 && xb < imgB.width()) ? rowB[xb] : black;
+
+                int t = m[x]; // 0–255
+                out[x] = qRgb((qRed(cA)   * (255 - t) + qRed(cB)   * t + 127) / 255,
+                              (qGreen(cA) * (255 - t) + qGreen(cB) * t + 127) / 255,
+                              (qBlue(cA)  * (255 - t) + qBlue(cB)  * t + 127) / 255);
             }
         }
 
-        update(); // trigger repaint
+        update(r); // trigger repaint
     }
 
 
@@ -140,7 +216,14 @@ QPoint lastPos;
         if ((e->buttons() & Qt::LeftButton) &&
             (mode == Tool_PaintFromA || mode == Tool_PaintFromB) &&
             paintSourceSet) {
-            paintFromSource(e->pos());
+            // Space dabs a quarter radius apart so fast strokes stay solid
+            QPointF delta = e->pos() - lastPos;
+            float spacing = qMax(1.0f, radius * 0.25f);
+            int steps = qMax(1, int(std::hypot(delta.x(), delta.y()) / spacing));
+            for (int i = 1; i <= steps; ++i)
+                paintFromSource((QPointF(lastPos) + delta * (float(i) / steps)).toPoint());
+            lastPos = e->pos();
+            return;
         }
 
 
@@ -183,75 +266,56 @@ applyBrush(e->pos());
 
     }
 
+    // Clone tools: Paint-from A/B clone into layer A/B, taking pixels from
+    // whichever image the source point was Alt-picked on.
+    QImage &cloneTarget() { return (mode == Tool_PaintFromA) ? imgA : imgB; }
+    QPoint cloneTargetOffset() const { return (mode == Tool_PaintFromA) ? offsetA : offsetB; }
+
+    void beginClone(QPoint canvasPos) {
+        // Aligned keeps the first stroke's offset; otherwise every stroke
+        // starts again from the picked source point.
+        if (!cloneAligned || !cloneOffsetSet) {
+            cloneOffset = paintSource - (canvasPos - cloneTargetOffset());
+            cloneOffsetSet = true;
+        }
+    }
+
     void paintFromSource(QPoint currentPos) {
         if (!paintSourceSet) return;
 
-        int radius = 10;//brushRadius;
-        QPoint delta = currentPos - paintSource;
-
-        for (int dy = -radius; dy <= radius; ++dy) {
-            for (int dx = -radius; dx <= radius; ++dx) {
-                QPoint offset(dx, dy);
-                float dist = std::sqrt(dx*dx + dy*dy);
-                if (dist > radius) continue;
-
-                QPoint src = paintSource + offset;
-                QPoint dst = currentPos + offset;
-
-                if (!mask.rect().contains(dst)) continue;
-
-                // Sampling image pixel from src — optional for smarter tools later
-                // QColor fromImg = (mode == Tool_PaintFromA) ? imgA.pixelColor(src) : imgB.pixelColor(src);
+        const QImage &src = (paintSourceImage == SourceA) ? imgA : imgB;
+        QPoint layerOffset = cloneTargetOffset();
+        QRect changed = cloner.dab(src, cloneTarget(), currentPos - layerOffset, cloneOffset, qRound(radius));
+        if (!changed.isEmpty())
+            updateFusion(changed.translated(layerOffset));
+    }
 
-                float feather = 1.0f - (dist / radius);
-                feather *= feather; // feathering curve
+    void mousePressEvent(QMouseEvent *event) override {
+        lastPos = event->pos();
 
-                float existing = mask.pixelColor(dst).redF();
-                float target = (mode == Tool_PaintFromA) ? 0.0f : 1.0f;
-                float blended = (1.0f - feather) * existing + feather * target;
+        if (mode == Tool_MoveA || mode == Tool_MoveB) {
+            dragStart = event->pos();
+            originalOffset = (mode == Tool_MoveA) ? offsetA : offsetB;
+        }
 
-                blended = std::clamp(blended, 0.0f, 1.0f);
-                mask.setPixelColor(dst, QColor::fromRgbF(blended, blended, blended));
+        if (mode == Tool_PaintFromA || mode == Tool_PaintFromB) {
+            if (event->button() == Qt::LeftButton && paintSourceSet) {
+                beginClone(lastPos);
+                paintFromSource(lastPos);
+            } else if (!paintSourceSet) {
+                QToolTip::showText(event->globalPos(), "Alt-click face A or B to pick a clone source first", this);
             }
+            return;
         }
 
-        updateFusion();
+        applyBrush(event->pos());
     }
 
-    void mousePressEvent(QMouseEvent *event) override {
-        QPoint click = event->pos();
-
-        QPoint imgAPos(0, 0);                      // top-left of imgA
-        QPoint imgBPos(imgA.width() + 10, 0);      // draw imgB with spacing
-        QPoint fusionPos(0, imgA.height() + 10);   // fusion drawn below them
-
-            QRect imgARect(imgAPos, imgA.size());
-            QRect imgBRect(imgBPos, imgB.size());
-
-            if (imgARect.contains(click)) {
-                paintSource = click - imgAPos;
-                paintSourceImage = SourceA;
-                paintSourceSet = true;
-                qDebug() << "Picked source from imgA at:" << paintSource;
-            } else if (imgBRect.contains(click)) {
-                paintSource = click - imgBPos;
-                paintSourceImage = SourceB;
-                paintSourceSet = true;
-                qDebug() << "Picked source from imgB at:" << paintSource;
-            } else {
-                qDebug() << "Clicked outside source images";
-            }
-
-
-
-        if (event->button() == Qt::LeftButton && paintSourceSet) {
-            lastPos = event->pos();
-            paintFromSource(lastPos);
-        }
+    void mouseReleaseEvent(QMouseEvent *) override {
+        if ((mode == Tool_PaintFromA || mode == Tool_PaintFromB) && paintSourceSet && layersChanged)
+            layersChanged();
     }
 
-
-
     void applyBrush(QPoint pos) {
         if (mode == Tool_Smooth) {
             int size = radius * 2;
@@ -312,6 +376,7 @@ applyBrush(e->pos());
             paintSource = imagePos;
             paintSourceImage = (src == ImageView::SourceA) ? SourceA : SourceB;
             paintSourceSet = true;
+            cloneOffsetSet = false;
             qDebug() << "Source set from view:" << src << "at" << imagePos;
         }
 
@@ -367,8 +432,11 @@ int main(int argc, char *argv[]) {
     QRadioButton *smooth = new QRadioButton("Smooth");
     QRadioButton *movea = new QRadioButton("Move A");
     QRadioButton *moveb = new QRadioButton("Move B");
-    QRadioButton *paintfa = new QRadioButton("Paintf A");
-    QRadioButton *paintfb = new QRadioButton("Paintf B");
+    QRadioButton *paintfa = new QRadioButton("Clone A");
+    QRadioButton *paintfb = new QRadioButton("Clone B");
+    QCheckBox *aligned = new QCheckBox("Aligned");
+    aligned->setChecked(true);
+    QObject::connect(aligned, &QCheckBox::toggled, canvas, &FusionCanvas::setCloneAligned);
     paintA->setChecked(true);
     tools->addButton(paintA, Tool_PaintA);
     tools->addButton(paintB, Tool_PaintB);
@@ -381,6 +449,10 @@ int main(int argc, char *argv[]) {
 
     QObject::connect(viewA, &ImageView::sourcePointPicked, canvas, &FusionCanvas::setPaintSource);
     QObject::connect(viewB, &ImageView::sourcePointPicked, canvas, &FusionCanvas::setPaintSource);
+    canvas->layersChanged = [=]() {
+        viewA->setPixmap(QPixmap::fromImage(canvas->getImageA()));
+        viewB->setPixmap(QPixmap::fromImage(canvas->getImageB()));
+    };
 
     QObject::connect(tools, QOverload<int>::of(&QButtonGroup::buttonClicked), [=](int id) {
         canvas->setTool(static_cast<ToolMode>(id));
@@ -403,6 +475,7 @@ int main(int argc, char *argv[]) {
     controls->addWidget(paintB);
     controls->addWidget(paintfa);
     controls->addWidget(paintfb);
+    controls->addWidget(aligned);
     controls->addWidget(smear);
     controls->addWidget(smooth);
     controls->addWidget(movea);
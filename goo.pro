@@ -1,34 +1,20 @@
-QT       += core gui sql network
-
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-
-CONFIG += c++11
-
-# The following define makes your compiler emit warnings if you use
-# any Qt feature that has been marked deprecated (the exact warnings
-# depend on your compiler). Please consult the documentation of the
-# deprecated API in order to know how to port your code away from it.
-DEFINES += QT_DEPRECATED_WARNINGS
-
-# You can also make your code fail to compile if it uses deprecated APIs.
-# In order to do so, uncomment the following line.
-# You can also select to disable deprecated APIs only up to a certain version of Qt.
-#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
-
-SOURCES += \
-    main.cpp\
-
-HEADERS += \
-
-
-FORMS += \
-
-LIBS += -L/Users/macbook2015/Desktop/brew/lib
-
-INCLUDEPATH += /Users/macbook2015/Desktop/brew/include /Users/macbook2015/Desktop/brew/lib
-
-
-# Default rules for deployment.
-qnx: target.path = /tmp/$${TARGET}/bin
-else: unix:!android: target.path = /opt/$${TARGET}/bin
-!isEmpty(target.path): INSTALLS += target
+# Builds the shared goocore library and every app on top of it
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    goocore \
+    PowerGoo \
+    QFusionRoom \
+    FusionAnimation \
+    fusionbench
+
+PowerGoo.file = PowerGoo/goo.pro
+QFusionRoom.file = QFusionRoom/goo.pro
+FusionAnimation.file = FusionAnimation/goo.pro
+fusionbench.file = tools/fusionbench/fusionbench.pro
+
+PowerGoo.depends = goocore
+QFusionRoom.depends = goocore
+FusionAnimation.depends = goocore
+fusionbench.depends = goocore
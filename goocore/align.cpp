@@ -0,0 +1,180 @@
+#include "align.h"
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+
+namespace goo {
+
+LayerAligner::Grey LayerAligner::halve(const Grey &in) {
+    Grey out;
+    out.w = qMax(1, in.w / 2);
+    out.h = qMax(1, in.h / 2);
+    out.v.resize(size_t(out.w) * out.h);
+    if (!in.valid.empty())
+        out.valid.resize(out.v.size());
+    for (int y = 0; y < out.h; ++y) {
+        const int y0 = qMin(2 * y, in.h - 1), y1 = qMin(2 * y + 1, in.h - 1);
+        for (int x = 0; x < out.w; ++x) {
+            const int x0 = qMin(2 * x, in.w - 1), x1 = qMin(2 * x + 1, in.w - 1);
+            const size_t i[4] = { size_t(y0) * in.w + x0, size_t(y0) * in.w + x1, size_t(y1) * in.w + x0, size_t(y1) * in.w + x1 };
+            out.v[size_t(y) * out.w + x] = (in.v[i[0]] + in.v[i[1]] + in.v[i[2]] + in.v[i[3]]) * 0.25f;
+            if (!in.valid.empty())
+                out.valid[size_t(y) * out.w + x] = in.valid[i[0]] & in.valid[i[1]] & in.valid[i[2]] & in.valid[i[3]];
+        }
+    }
+    return out;
+}
+
+LayerTransform LayerAligner::transformOf(const Candidate &c) const {
+    LayerTransform xf = base;
+    xf.translate = QPointF(c.tx, c.ty);
+    xf.rotation = c.rotation;
+    xf.scale = c.scale;
+    return xf;
+}
+
+// Correlation of the reference with the moving source placed as 'c'; -1
+// if they overlap too little to tell
+double LayerAligner::score(int level, const Candidate &c) const {
+    const Grey &r = ref[level], &m = mov[level];
+    const double f = double(1 << level);
+    const QTransform t = QTransform::fromScale(f, f) * transformOf(c).toCanvas(movingSize).inverted() *
+                         QTransform::fromScale(1 / f, 1 / f);
+    const int stride = strides[level];
+    const QPointF step(t.m11() * stride, t.m12() * stride);
+
+    double n = 0, sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+    for (int y = stride / 2; y < r.h; y += stride) {
+        QPointF p = t.map(QPointF(stride / 2 + 0.5, y + 0.5)) - QPointF(0.5, 0.5);
+        for (int x = stride / 2; x < r.w; x += stride, p += step) {
+            const size_t i = size_t(y) * r.w + x;
+            if (!r.valid[i] || p.x() < 0 || p.y() < 0 || p.x() > m.w - 1 || p.y() > m.h - 1)
+                continue;
+            const int x0 = qMin(int(p.x()), qMax(0, m.w - 2)), y0 = qMin(int(p.y()), qMax(0, m.h - 2));
+            const int x1 = qMin(x0 + 1, m.w - 1), y1 = qMin(y0 + 1, m.h - 1);
+            const float fx = float(p.x() - x0), fy = float(p.y() - y0);
+            const float *r0 = &m.v[size_t(y0) * m.w], *r1 = &m.v[size_t(y1) * m.w];
+            const float top = r0[x0] + (r0[x1] - r0[x0]) * fx, bottom = r1[x0] + (r1[x1] - r1[x0]) * fx;
+            const double a = r.v[i], b = top + (bottom - top) * fy;
+            n += 1;
+            sx += a;
+            sy += b;
+            sxx += a * a;
+            syy += b * b;
+            sxy += a * b;
+        }
+    }
+    if (n < needed[level])
+        return -1;
+    const double vx = sxx - sx * sx / n, vy = syy - sy * sy / n;
+    if (vx <= 1e-6 || vy <= 1e-6)
+        return -1;
+    return (sxy - sx * sy / n) / std::sqrt(vx * vy);
+}
+
+void LayerAligner::evaluate(int level, QVector<Candidate> &candidates) const {
+    QtConcurrent::blockingMap(candidates, [&](Candidate &c) { c.score = score(level, c); });
+}
+
+// Steps to the best neighbour in all four parameters until none is better
+LayerAligner::Candidate LayerAligner::refine(int level, Candidate c, double tStep, double rStep, double sStep) const {
+    c.score = score(level, c);
+    for (int iter = 0; iter < 32; ++iter) {
+        QVector<Candidate> around;
+        for (int dx = -1; dx <= 1; ++dx)
+            for (int dy = -1; dy <= 1; ++dy)
+                for (int dr = -1; dr <= 1; ++dr)
+                    for (int ds = -1; ds <= 1; ++ds)
+                        if (dx || dy || dr || ds)
+                            around.append({c.tx + dx * tStep, c.ty + dy * tStep, c.rotation + dr * rStep,
+                                           qBound(0.1, c.scale * std::exp(ds * sStep), 10.0), 0});
+        evaluate(level, around);
+        const Candidate &best = *std::max_element(around.begin(), around.end(),
+                                                  [](const Candidate &a, const Candidate &b) { return a.score < b.score; });
+        if (best.score <= c.score)
+            break;
+        c = best;
+    }
+    return c;
+}
+
+LayerAligner::LayerAligner(const LayerMapping &reference, const QSize &canvasSize) {
+    Grey g;
+    g.w = canvasSize.width();
+    g.h = canvasSize.height();
+    g.v.resize(size_t(g.w) * g.h);
+    g.valid.resize(g.v.size());
+    const QImage &img = *reference.image;
+    for (int y = 0; y < g.h; ++y) {
+        for (int x = 0; x < g.w; ++x) {
+            const QPointF p = reference.map(x, y);
+            const size_t i = size_t(y) * g.w + x;
+            g.valid[i] = p.x() >= -0.5 && p.y() >= -0.5 && p.x() <= img.width() - 0.5 && p.y() <= img.height() - 0.5;
+            g.v[i] = g.valid[i] ? float(qGray(sampleLayer(img, p))) : 0.0f;
+        }
+    }
+    ref.append(g);
+    while (qMax(ref.last().w, ref.last().h) > TopSize && ref.size() < 7)
+        ref.append(halve(ref.last()));
+
+    for (const Grey &level : ref) {
+        int covered = 0;
+        for (uchar v : level.valid)
+            covered += v;
+        const int stride = qMax(1, int(std::sqrt(double(covered) / MaxSamples)));
+        strides.append(stride);
+        needed.append(qMax(16, int(0.4 * covered / (stride * stride))));
+    }
+}
+
+LayerTransform LayerAligner::align(const QImage &moving, const LayerTransform &start) {
+    base = start;
+    movingSize = moving.size();
+    Grey g;
+    g.w = moving.width();
+    g.h = moving.height();
+    g.v.resize(size_t(g.w) * g.h);
+    for (int y = 0; y < g.h; ++y) {
+        const QRgb *row = reinterpret_cast<const QRgb*>(moving.constScanLine(y));
+        for (int x = 0; x < g.w; ++x)
+            g.v[size_t(y) * g.w + x] = float(qGray(row[x]));
+    }
+    mov.clear();
+    mov.append(g);
+    while (mov.size() < ref.size())
+        mov.append(halve(mov.last()));
+
+    // Everything within a third of the canvas, 15 degrees and 20% of
+    // where the layer is now, a coarse pixel apart
+    const int top = ref.size() - 1;
+    const double f = double(1 << top);
+    const int reach = qMax(ref[top].w, ref[top].h) / 3;
+    const double rStep = 3, sStep = std::log(1.05);
+    QVector<Candidate> grid;
+    for (int r = -5; r <= 5; ++r)
+        for (int s = -4; s <= 4; ++s)
+            for (int ty = -reach; ty <= reach; ++ty)
+                for (int tx = -reach; tx <= reach; ++tx)
+                    grid.append({start.translate.x() + tx * f, start.translate.y() + ty * f, start.rotation + r * rStep,
+                                 qBound(0.1, start.scale * std::exp(s * sStep), 10.0), 0});
+    evaluate(top, grid);
+    std::partial_sort(grid.begin(), grid.begin() + qMin(int(Seeds), grid.size()), grid.end(),
+                      [](const Candidate &a, const Candidate &b) { return a.score > b.score; });
+    QVector<Candidate> seeds = grid.mid(0, Seeds);
+    seeds.append({start.translate.x(), start.translate.y(), start.rotation, start.scale, 0});
+
+    // Each level's own pixel is the step, then half of it on the last
+    for (int level = top; level >= 0; --level) {
+        const double k = double(1 << level) / f;
+        for (Candidate &c : seeds)
+            c = refine(level, c, double(1 << level), rStep * k, sStep * k);
+    }
+    for (Candidate &c : seeds)
+        c = refine(0, c, 0.5, rStep / (2 * f), sStep / (2 * f));
+
+    const Candidate &best = *std::max_element(seeds.begin(), seeds.end(),
+                                              [](const Candidate &a, const Candidate &b) { return a.score < b.score; });
+    return transformOf(best);
+}
+
+} // namespace goo
@@ -0,0 +1,56 @@
+#ifndef ALIGN_H
+#define ALIGN_H
+
+#include "layers.h"
+#include <QImage>
+#include <QSize>
+#include <QVector>
+#include <vector>
+
+namespace goo {
+
+// Finds the transform that lays one source over another as it already sits
+// on the canvas, for Auto Align. Both are reduced to grey pyramids and
+// compared by normalized cross-correlation, so exposure and contrast may
+// differ. Every translation, rotation and scale near the current placement
+// is scored on the coarsest level; the best few are refined by local search
+// level by level down to the proxy itself. Flips are kept as they are.
+class LayerAligner {
+    static const int TopSize = 40;        // longest side of the coarsest level, about
+    static const int MaxSamples = 20000;  // per score; denser levels are strided
+    static const int Seeds = 4;
+
+    struct Grey {
+        int w = 0, h = 0;
+        std::vector<float> v;
+        std::vector<uchar> valid; // empty when every pixel is
+    };
+
+    struct Candidate {
+        double tx, ty, rotation, scale;
+        double score;
+    };
+
+    QVector<Grey> ref, mov;
+    QVector<int> strides, needed; // sample spacing, and the overlap a score needs, per level
+    LayerTransform base;
+    QSizeF movingSize;
+
+    static Grey halve(const Grey &in);
+    LayerTransform transformOf(const Candidate &c) const;
+    double score(int level, const Candidate &c) const;
+    void evaluate(int level, QVector<Candidate> &candidates) const;
+    Candidate refine(int level, Candidate c, double tStep, double rStep, double sStep) const;
+
+public:
+    // 'reference' as it sits on a canvas of 'canvasSize'
+    LayerAligner(const LayerMapping &reference, const QSize &canvasSize);
+
+    // Where to put 'moving', a 32-bit source, so it lies over the reference,
+    // starting the search from 'start'
+    LayerTransform align(const QImage &moving, const LayerTransform &start);
+};
+
+} // namespace goo
+
+#endif // ALIGN_H
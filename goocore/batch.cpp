@@ -0,0 +1,257 @@
+#include "batch.h"
+#include "layers.h"
+#include "trace.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <QtConcurrent>
+#include <atomic>
+#include <deque>
+
+namespace goo {
+
+// Fixed-capacity hand-off between pipeline stages. push() blocks while the
+// queue is full, pop() while it is empty; once closed, pop() drains what is
+// left and then returns false.
+template <typename T>
+class BoundedQueue {
+    QMutex lock;
+    QWaitCondition notFull, notEmpty;
+    std::deque<T> items;
+    const size_t capacity;
+    bool closed = false;
+
+public:
+    explicit BoundedQueue(size_t cap) : capacity(cap) {}
+
+    void push(T item) {
+        QMutexLocker guard(&lock);
+        while (items.size() >= capacity)
+            notFull.wait(&lock);
+        items.push_back(std::move(item));
+        notEmpty.wakeOne();
+    }
+
+    bool pop(T &item) {
+        QMutexLocker guard(&lock);
+        while (items.empty() && !closed)
+            notEmpty.wait(&lock);
+        if (items.empty())
+            return false;
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.wakeOne();
+        return true;
+    }
+
+    void close() {
+        QMutexLocker guard(&lock);
+        closed = true;
+        notEmpty.wakeAll();
+    }
+};
+
+// A manifest line and, as it moves through the stages, its images
+struct BatchJob {
+    int line = 0;
+    QString pathA, pathB, pathMask, output;
+    LayerTransform xfA, xfB;
+
+    QImage imgA, imgB, mask; // filled by the decode stage, mask as a weight plane
+    QImage result;           // filled by the blend stage
+};
+
+// Splits a manifest line on whitespace; a field in double quotes keeps its
+// spaces. False on an unterminated quote or one running into the next field.
+static bool splitFields(const QString &line, QStringList &fields) {
+    const int n = line.size();
+    for (int i = 0;;) {
+        while (i < n && line.at(i).isSpace())
+            ++i;
+        if (i == n)
+            return true;
+        if (line.at(i) == '"') {
+            const int close = line.indexOf('"', i + 1);
+            if (close < 0 || (close + 1 < n && !line.at(close + 1).isSpace()))
+                return false;
+            fields << line.mid(i + 1, close - i - 1);
+            i = close + 1;
+        } else {
+            const int start = i;
+            while (i < n && !line.at(i).isSpace())
+                ++i;
+            fields << line.mid(start, i - start);
+        }
+    }
+}
+
+static bool parseManifest(const QString &path, QVector<BatchJob> &jobs, QTextStream &err) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        err << "Cannot open manifest " << path << "\n";
+        return false;
+    }
+    QTextStream in(&file);
+    int lineNo = 0;
+    while (!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        ++lineNo;
+        if (line.isEmpty() || line.startsWith("#"))
+            continue;
+        QStringList f;
+        if (!splitFields(line, f)) {
+            err << path << ":" << lineNo << ": unbalanced quotes\n";
+            return false;
+        }
+        if (f.size() != 10) {
+            err << path << ":" << lineNo << ": expected 10 fields, got " << f.size() << "\n";
+            return false;
+        }
+        BatchJob job;
+        job.line = lineNo;
+        job.pathA = f[0];
+        job.pathB = f[1];
+        job.pathMask = f[2];
+        job.xfA.translate = QPointF(f[3].toDouble(), f[4].toDouble());
+        job.xfB.translate = QPointF(f[5].toDouble(), f[6].toDouble());
+        job.xfA.flipH = f[7].toInt() != 0;
+        job.xfB.flipH = f[8].toInt() != 0;
+        job.output = f[9];
+        jobs.append(job);
+    }
+    return true;
+}
+
+// A Grayscale8 A/B mask (0 = A, 255 = B) as a two-layer weight plane
+static QImage weightPlane(const QImage &mask) {
+    QImage plane(mask.size(), QImage::Format_RGBA8888);
+    plane.fill(0);
+    for (int y = 0; y < mask.height(); ++y) {
+        const uchar *src = mask.constScanLine(y);
+        uchar *dst = plane.scanLine(y);
+        for (int x = 0; x < mask.width(); ++x) {
+            dst[x * LayersPerPlane] = uchar(255 - src[x]);
+            dst[x * LayersPerPlane + 1] = src[x];
+        }
+    }
+    return plane;
+}
+
+// Blends one decoded job with the same full-resolution kernel as Export
+static void blendJob(BatchJob &job) {
+    const QSize size = job.imgA.size();
+    LayerMapping a, b;
+    a.image = &job.imgA;
+    a.toSource = job.xfA.toCanvas(size).inverted();
+
+    // B's transform applies to B as fitted, like the editor's proxy
+    const double fit = qMin(double(size.width()) / job.imgB.width(), double(size.height()) / job.imgB.height());
+    b.image = &job.imgB;
+    b.toSource = job.xfB.toCanvas(QSizeF(job.imgB.size()) * fit).inverted() * QTransform::fromScale(1 / fit, 1 / fit);
+
+    const QTransform maskMap = QTransform::fromScale(double(job.mask.width()) / size.width(),
+                                                     double(job.mask.height()) / size.height());
+
+    job.result = QImage(size, QImage::Format_RGB888);
+    compositeTile(QVector<LayerMapping>() << a << b, QVector<QImage>() << job.mask, maskMap,
+                  QRect(QPoint(0, 0), size), job.result.bits(), job.result.bytesPerLine());
+}
+
+int runBatch(const QString &manifest, int threads, QTextStream &out, QTextStream &err) {
+    QVector<BatchJob> jobs;
+    if (!parseManifest(manifest, jobs, err))
+        return 1;
+
+    if (threads <= 0)
+        threads = QThread::idealThreadCount();
+    threads = qMax(3, threads);
+    const int decoders = qMax(1, threads / 3);
+    const int encoders = qMax(1, threads / 3);
+    const int blenders = qMax(1, threads - decoders - encoders);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(decoders + blenders + encoders);
+    BoundedQueue<BatchJob> decoded(blenders * 2), blended(encoders * 2);
+    std::atomic<int> nextJob(0), decodersLeft(decoders), blendersLeft(blenders);
+    std::atomic<int> done(0), failed(0);
+    QMutex errLock;
+    auto fail = [&](const BatchJob &job, const QString &why) {
+        QMutexLocker guard(&errLock);
+        err << "line " << job.line << ": " << why << "\n";
+        err.flush();
+        ++failed;
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+    QVector<QFuture<void>> workers;
+
+    for (int i = 0; i < decoders; ++i) {
+        workers.append(QtConcurrent::run(&pool, [&]() {
+            for (int n; (n = nextJob++) < jobs.size();) {
+                GOO_TRACE_SCOPE("decode");
+                BatchJob job = jobs[n];
+                // Premultiplied like the editor's layers, so a transparent
+                // source blends over black here too
+                job.imgA = QImage(job.pathA).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+                job.imgB = QImage(job.pathB).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+                if (job.pathMask == "-") {
+                    // 128 for both, as the editor starts; no grey level maps to that
+                    job.mask = QImage(1, 1, QImage::Format_RGBA8888);
+                    job.mask.fill(0);
+                    job.mask.scanLine(0)[0] = job.mask.scanLine(0)[1] = 128;
+                } else {
+                    job.mask = weightPlane(QImage(job.pathMask).convertToFormat(QImage::Format_Grayscale8));
+                }
+                if (job.imgA.isNull() || job.imgB.isNull() || job.mask.isNull()) {
+                    fail(job, "could not decode inputs");
+                    continue;
+                }
+                decoded.push(std::move(job));
+            }
+            if (--decodersLeft == 0)
+                decoded.close();
+        }));
+    }
+
+    for (int i = 0; i < blenders; ++i) {
+        workers.append(QtConcurrent::run(&pool, [&]() {
+            BatchJob job;
+            while (decoded.pop(job)) {
+                GOO_TRACE_SCOPE("blend");
+                blendJob(job);
+                job.imgA = job.imgB = job.mask = QImage(); // free inputs early
+                blended.push(std::move(job));
+            }
+            if (--blendersLeft == 0)
+                blended.close();
+        }));
+    }
+
+    for (int i = 0; i < encoders; ++i) {
+        workers.append(QtConcurrent::run(&pool, [&]() {
+            BatchJob job;
+            while (blended.pop(job)) {
+                GOO_TRACE_SCOPE("encode");
+                if (job.result.save(job.output))
+                    ++done;
+                else
+                    fail(job, "could not write " + job.output);
+            }
+        }));
+    }
+
+    for (QFuture<void> &w : workers)
+        w.waitForFinished();
+
+    const double seconds = timer.elapsed() / 1000.0;
+    out << done.load() << " pairs blended, " << failed.load() << " failed in " << QString::number(seconds, 'f', 2) << " s ("
+        << QString::number(seconds > 0 ? done.load() / seconds : 0.0, 'f', 2) << " pairs/sec, "
+        << decoders << " decode / " << blenders << " blend / " << encoders << " encode threads)\n";
+    return failed ? 2 : 0;
+}
+
+} // namespace goo
@@ -0,0 +1,30 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <QString>
+#include <QTextStream>
+
+namespace goo {
+
+// Headless Fusion Room: blends the A/B face pairs listed in 'manifest', one
+// job per line:
+//   A  B  mask  offsetAx offsetAy  offsetBx offsetBy  flipA flipB  output
+// Fields are separated by spaces or tabs; put a path that has spaces in it
+// in double quotes ("my faces/a.jpg"). Paths cannot contain a double quote.
+// Offsets are in A's full-resolution pixels and may be fractional, flips are
+// 0/1 (horizontal) and a mask of "-" means an even mix. B is fitted into A's
+// frame the same way the editor does, and the mask is stretched over it.
+// Blank lines and lines starting with '#' are skipped.
+//
+// Decode, blend and encode run as separate worker groups joined by bounded
+// queues, so disk, codecs and the blend kernel overlap without any stage
+// running ahead of the others by more than a few images. 'threads' is split
+// between them (0 or less: all cores, and never fewer than three).
+//
+// Failures go to 'err' as they happen and a summary to 'out'. Returns 0, 1
+// if the manifest cannot be read, or 2 if any job failed.
+int runBatch(const QString &manifest, int threads, QTextStream &out, QTextStream &err);
+
+} // namespace goo
+
+#endif // BATCH_H
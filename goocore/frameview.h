@@ -0,0 +1,70 @@
+#ifndef FRAMEVIEW_H
+#define FRAMEVIEW_H
+
+#include <QImage>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QWidget>
+#include "trace.h"
+
+namespace goo {
+
+// Shows an image that its owner keeps rendering into, with no QPixmap in
+// between. The view holds a pointer, never a copy, so the owner's writes do
+// not detach the buffer and a repaint reads the pixels where they are.
+//
+// Keep the image in Format_ARGB32_Premultiplied (or RGB32): that is what
+// the window's backing store holds, so painting it is a straight copy of
+// the exposed rect and no conversion. Header only, as goocore itself does
+// not link QtWidgets.
+class FrameView : public QWidget {
+public:
+    explicit FrameView(QWidget *parent = nullptr) : QWidget(parent) {
+        setAttribute(Qt::WA_OpaquePaintEvent); // every exposed pixel is painted below
+    }
+
+    // 'image' has to stay where it is until the next call or the view goes
+    // away; a null pointer shows nothing. Call again after resizing it.
+    void setFrame(const QImage *image) {
+        frame = image;
+        if (imageSize() != shownSize) {
+            shownSize = imageSize();
+            updateGeometry();
+        }
+        update();
+    }
+
+    // The owner changed 'area' of the frame (all of it if null)
+    void frameChanged(const QRect &area = QRect()) {
+        if (area.isNull())
+            update();
+        else
+            update(area);
+    }
+
+    const QImage *currentFrame() const { return frame; }
+
+    QSize sizeHint() const override { return imageSize(); }
+
+protected:
+    void paintEvent(QPaintEvent *e) override {
+        GOO_TRACE_SCOPE("present");
+        QPainter p(this);
+        const QRect r = e->rect();
+        const QRect shown = frame ? r.intersected(frame->rect()) : QRect();
+        if (shown != r)
+            p.fillRect(r, palette().window());
+        if (!shown.isEmpty())
+            p.drawImage(shown.topLeft(), *frame, shown);
+    }
+
+private:
+    QSize imageSize() const { return frame ? frame->size() : QSize(); }
+
+    const QImage *frame = nullptr;
+    QSize shownSize;
+};
+
+} // namespace goo
+
+#endif // FRAMEVIEW_H
@@ -0,0 +1,326 @@
+#include "goocore.h"
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <QThread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace goo {
+
+void setThreadCount(int n) {
+#ifdef _OPENMP
+    omp_set_num_threads(n > 0 ? n : QThread::idealThreadCount());
+#else
+    Q_UNUSED(n);
+#endif
+}
+
+int threadCount() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+// t runs 0 (all a) .. 1 << WeightBits (all b), all four channels
+template <typename Pixel>
+static inline Pixel lerpPixel(Pixel a, Pixel b, int t) {
+    typedef PixelTraits<Pixel> T;
+    typedef typename T::Accum Accum;
+    const int one = 1 << T::WeightBits;
+    int c[4];
+    for (int i = 0; i < 4; ++i)
+        c[i] = int((Accum(T::channel(a, i)) * (one - t) + Accum(T::channel(b, i)) * t + (one >> 1)) >> T::WeightBits);
+    return T::make(c[0], c[1], c[2], c[3]);
+}
+
+// Weight of 'f' (0 .. 1) in the format's fixed point
+template <typename Pixel>
+static inline int weight(float f) {
+    const int one = 1 << PixelTraits<Pixel>::WeightBits;
+    return qBound(0, int(f * one + 0.5f), one);
+}
+
+template <typename Pixel>
+Pixel sampleBilinear(const BasicConstImage<Pixel> &img, float x, float y) {
+    typedef PixelTraits<Pixel> T;
+    typedef typename T::Accum Accum;
+    const int bits = T::WeightBits, one = 1 << bits;
+    const int x0 = qFloor(x), y0 = qFloor(y);
+    const int wx = int((x - x0) * one), wy = int((y - y0) * one);
+
+    // Missing neighbours repeat the nearest corner, a missing corner is clear
+    const Pixel c00 = img.valid(x0, y0) ? img.row(y0)[x0] : T::make(0, 0, 0, 0);
+    const Pixel c10 = img.valid(x0 + 1, y0) ? img.row(y0)[x0 + 1] : c00;
+    const Pixel c01 = img.valid(x0, y0 + 1) ? img.row(y0 + 1)[x0] : c00;
+    const Pixel c11 = img.valid(x0 + 1, y0 + 1) ? img.row(y0 + 1)[x0 + 1] : c00;
+
+    int c[4];
+    for (int i = 0; i < 4; ++i) {
+        const Accum top = Accum(T::channel(c00, i)) * (one - wx) + Accum(T::channel(c10, i)) * wx;
+        const Accum bottom = Accum(T::channel(c01, i)) * (one - wx) + Accum(T::channel(c11, i)) * wx;
+        c[i] = int((top * (one - wy) + bottom * wy + (Accum(1) << (2 * bits - 1))) >> (2 * bits));
+    }
+    return T::make(c[0], c[1], c[2], c[3]);
+}
+
+QRect strokeBounds(const Stroke &s, const QRect &image) {
+    const QPointF &l = s.location;
+    return QRect(QPoint(qCeil(l.x() - s.radius), qCeil(l.y() - s.radius)),
+                 QPoint(qFloor(l.x() + s.radius), qFloor(l.y() + s.radius))).intersected(image);
+}
+
+template <typename Pixel>
+QRect warp(const BasicConstImage<Pixel> &src, const BasicConstImage<Pixel> &original, const BasicImage<Pixel> &dst, const Stroke &s) {
+    if (src.isNull() || dst.width != src.width || dst.height != src.height || s.radius <= 0)
+        return QRect();
+    if (s.brush == Brush_Ungoo && (original.width != src.width || original.height != src.height))
+        return QRect(); // nothing to restore from
+
+    const QRect r = strokeBounds(s, src.rect());
+    const float lx = float(s.location.x()), ly = float(s.location.y());
+    const float dirX = float(s.direction.x()), dirY = float(s.direction.y());
+    const float k = s.force / s.radius;
+    const int top = r.top(), bottom = r.bottom();
+
+    #pragma omp parallel for
+    for (int y = top; y <= bottom; ++y) {
+        const Pixel *in = src.row(y);
+        Pixel *out = dst.row(y);
+        for (int x = r.left(); x <= r.right(); ++x) {
+            const float dx = x - lx, dy = y - ly;
+            const float dist = std::sqrt(dx * dx + dy * dy);
+            if (dist >= s.radius) {
+                out[x] = in[x];
+                continue;
+            }
+            const float n = 1.0f - dist / s.radius;
+            const float smoothed = n * n * (3 - 2 * n); // smoothstep
+
+            float ox = 0, oy = 0;
+            switch (s.brush) {
+            case Brush_Smear:
+                ox = dirX * k * smoothed;
+                oy = dirY * k * smoothed;
+                break;
+            case Brush_Grow:
+            case Brush_Shrink:
+                if (dist > 0) {
+                    const float g = (s.brush == Brush_Grow ? k : -k) * smoothed / dist;
+                    ox = dx * g;
+                    oy = dy * g;
+                }
+                break;
+            case Brush_Pinch:
+                ox = -dx * 0.01f * s.force * smoothed;
+                oy = -dy * 0.01f * s.force * smoothed;
+                break;
+            case Brush_Ungoo: {
+                const float restore = qBound(0.0f, smoothed * (s.force / 50.0f), 1.0f);
+                out[x] = lerpPixel(in[x], original.row(y)[x], weight<Pixel>(restore));
+                continue;
+            }
+            }
+            out[x] = sampleBilinear(src, x - ox, y - oy);
+        }
+    }
+    return r;
+}
+
+template <typename Pixel>
+void blendFusion(const BasicConstImage<Pixel> &a, const BasicConstImage<Pixel> &b, const BasicImage<Pixel> &dst,
+                 float blendAmount, float warpAmount, int time) {
+    typedef PixelTraits<Pixel> T;
+    typedef typename T::Accum Accum;
+    const int w = dst.width, h = dst.height;
+    const Pixel black = T::make(0, 0, 0, T::max());
+    if (a.width < w || a.height < h) { // no A pixel for part of the frame
+        for (int y = 0; y < h; ++y)
+            std::fill(dst.row(y), dst.row(y) + w, black);
+        return;
+    }
+    const int bits = T::WeightBits, one = 1 << bits;
+    const int t = weight<Pixel>(blendAmount);
+
+    // B's x ripples with the row and its y with the column, so both fit a table
+    std::vector<float> shiftX(h), shiftY(w);
+    for (int y = 0; y < h; ++y)
+        shiftX[y] = float(warpAmount * std::sin(2 * 3.14 * y / 128 + time * 0.05));
+    for (int x = 0; x < w; ++x)
+        shiftY[x] = float(warpAmount * std::cos(2 * 3.14 * x / 128 + time * 0.05));
+
+    #pragma omp parallel for
+    for (int y = 0; y < h; ++y) {
+        const Pixel *rowA = a.row(y);
+        Pixel *out = dst.row(y);
+        for (int x = 0; x < w; ++x) {
+            const int xx = int(x + shiftX[y]), yy = int(y + shiftY[x]);
+            if (!b.valid(xx, yy)) {
+                out[x] = black;
+                continue;
+            }
+            const Pixel ca = rowA[x], cb = b.row(yy)[xx];
+            int c[3];
+            for (int i = 0; i < 3; ++i)
+                c[i] = int((Accum(T::channel(ca, i)) * (one - t) + Accum(T::channel(cb, i)) * t) >> bits);
+            out[x] = T::make(c[0], c[1], c[2], T::max());
+        }
+    }
+}
+
+void fractal(const Image &dst, double zoom, int time) {
+    const int w = dst.width, h = dst.height;
+    const double cx = -0.7, cy = 0.27015;
+    const double drift = 0.1 * std::sin(time * 0.05);
+
+    #pragma omp parallel for
+    for (int y = 0; y < h; ++y) {
+        QRgb *out = dst.row(y);
+        for (int x = 0; x < w; ++x) {
+            double zx = 1.5 * (x - w / 2) / (0.5 * zoom * w);
+            double zy = (y - h / 2) / (0.5 * zoom * h);
+            int i = 0;
+            while (zx * zx + zy * zy < 4 && i < 255) {
+                double tmp = zx * zx - zy * zy + cx + drift;
+                zy = 2.0 * zx * zy + cy;
+                zx = tmp;
+                ++i;
+            }
+            out[x] = qRgb(i, i, i);
+        }
+    }
+}
+
+void tileSpin(const ConstImage &src, const Image &dst, float angleDeg, int tiles) {
+    const int w = dst.width, h = dst.height;
+    if (tiles < 1)
+        return;
+    const int tileW = w / tiles, tileH = h / tiles;
+    const double angle = qDegreesToRadians(double(angleDeg));
+    const double c = std::cos(angle), s = std::sin(angle);
+
+    // Each tile turns about its (integer) centre the way QPainter::rotate
+    // would; later tiles are drawn over earlier ones where they overlap.
+    struct Tile {
+        QRect rect;
+        double cx, cy;
+        QRect bounds; // destination pixels the turned tile can reach
+    };
+    std::vector<Tile> list;
+    for (int ty = 0; ty < tiles; ++ty) {
+        for (int tx = 0; tx < tiles; ++tx) {
+            Tile t;
+            t.rect = QRect(tx * tileW, ty * tileH, tileW, tileH);
+            t.cx = t.rect.center().x();
+            t.cy = t.rect.center().y();
+            double x0 = 1e30, y0 = 1e30, x1 = -1e30, y1 = -1e30;
+            const double xs[2] = { double(t.rect.left()), double(t.rect.left() + tileW) };
+            const double ys[2] = { double(t.rect.top()), double(t.rect.top() + tileH) };
+            for (double px : xs) {
+                for (double py : ys) {
+                    const double dx = px - t.cx, dy = py - t.cy;
+                    const double qx = c * dx - s * dy + t.cx, qy = s * dx + c * dy + t.cy;
+                    x0 = qMin(x0, qx); x1 = qMax(x1, qx);
+                    y0 = qMin(y0, qy); y1 = qMax(y1, qy);
+                }
+            }
+            t.bounds = QRect(QPoint(qFloor(x0), qFloor(y0)), QPoint(qCeil(x1), qCeil(y1))).intersected(dst.rect());
+            list.push_back(t);
+        }
+    }
+
+    #pragma omp parallel for
+    for (int y = 0; y < h; ++y) {
+        QRgb *out = dst.row(y);
+        std::fill(out, out + w, qRgb(0, 0, 0));
+        for (const Tile &t : list) {
+            if (y < t.bounds.top() || y > t.bounds.bottom())
+                continue;
+            const double dy = y + 0.5 - t.cy;
+            for (int x = t.bounds.left(); x <= t.bounds.right(); ++x) {
+                const double dx = x + 0.5 - t.cx;
+                const double sx = c * dx + s * dy + t.cx, sy = -s * dx + c * dy + t.cy;
+                if (sx < t.rect.left() || sy < t.rect.top() || sx >= t.rect.left() + tileW || sy >= t.rect.top() + tileH)
+                    continue;
+                const int ix = int(sx), iy = int(sy);
+                if (src.valid(ix, iy))
+                    out[x] = src.row(iy)[ix];
+            }
+        }
+    }
+}
+
+void goovie(const ConstImage &src, const Image &dst, float strength, int time) {
+    const int w = dst.width, h = dst.height;
+    const int cx = w / 2, cy = h / 2;
+
+    #pragma omp parallel for
+    for (int y = 0; y < h; ++y) {
+        QRgb *out = dst.row(y);
+        for (int x = 0; x < w; ++x) {
+            const float dx = float(x - cx), dy = float(y - cy);
+            const float dist = std::hypot(dx, dy);
+            const float factor = float(strength * std::sin(dist / 20.0 - time * 0.1));
+            const int sx = int(x + dx * factor * 0.01f), sy = int(y + dy * factor * 0.01f);
+            out[x] = src.valid(sx, sy) ? src.row(sy)[sx] : qRgb(0, 0, 0);
+        }
+    }
+}
+
+void composite(const ConstImage &src, const Image &dst, float opacity) {
+    const int w = qMin(src.width, dst.width), h = qMin(src.height, dst.height);
+    const int t = weight<QRgb>(opacity);
+
+    #pragma omp parallel for
+    for (int y = 0; y < h; ++y) {
+        const QRgb *in = src.row(y);
+        QRgb *out = dst.row(y);
+        for (int x = 0; x < w; ++x)
+            out[x] = lerpPixel(out[x], in[x], t) | 0xff000000;
+    }
+}
+
+template <typename Pixel>
+void mixLayers(const Pixel *const *rows, const uchar *weights, int count, int n, Pixel *out) {
+    typedef PixelTraits<Pixel> T;
+    typedef typename T::Accum Accum;
+    for (int x = 0; x < n; ++x, weights += count) {
+        Accum r = 0, g = 0, b = 0;
+        int sum = 0;
+        for (int k = 0; k < count; ++k) {
+            const int w = weights[k];
+            if (!w)
+                continue;
+            const Pixel c = rows[k][x];
+            r += Accum(T::channel(c, 0)) * w;
+            g += Accum(T::channel(c, 1)) * w;
+            b += Accum(T::channel(c, 2)) * w;
+            sum += w;
+        }
+        if (!sum) {
+            for (int k = 0; k < count; ++k) {
+                r += T::channel(rows[k][x], 0);
+                g += T::channel(rows[k][x], 1);
+                b += T::channel(rows[k][x], 2);
+            }
+            sum = count;
+        }
+        out[x] = T::make(int((r + sum / 2) / sum), int((g + sum / 2) / sum), int((b + sum / 2) / sum), T::max());
+    }
+}
+
+// The formats the library is built for
+#define GOO_INSTANTIATE(Pixel) \
+    template Pixel sampleBilinear(const BasicConstImage<Pixel>&, float, float); \
+    template QRect warp(const BasicConstImage<Pixel>&, const BasicConstImage<Pixel>&, const BasicImage<Pixel>&, const Stroke&); \
+    template void blendFusion(const BasicConstImage<Pixel>&, const BasicConstImage<Pixel>&, const BasicImage<Pixel>&, float, float, int); \
+    template void mixLayers(const Pixel *const*, const uchar*, int, int, Pixel*);
+
+GOO_INSTANTIATE(QRgb)
+GOO_INSTANTIATE(QRgba64)
+
+} // namespace goo
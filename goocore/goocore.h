@@ -0,0 +1,160 @@
+#ifndef GOOCORE_H
+#define GOOCORE_H
+
+#include <QImage>
+#include <QPointF>
+#include <QRect>
+#include <QRgba64>
+
+// Image kernels shared by Goo, Fusion Room, Fusion Animation and the
+// headless tools.
+//
+// Every kernel works on caller-owned pixel buffers and keeps no state
+// between calls: any number of threads may call in at once as long as no
+// two of them write the same buffer. Kernels spread their rows over OpenMP
+// threads themselves.
+//
+// The warp and blend kernels are templates on the pixel type, instantiated
+// for the two formats below, so the 8-bit path compiles to the same fixed
+// point code it always had and pays nothing for the 16-bit one.
+namespace goo {
+
+template <typename Pixel> struct PixelTraits;
+
+// QImage::Format_ARGB32, straight alpha; 8-bit weights in int
+template <> struct PixelTraits<QRgb> {
+    typedef int Accum;
+    static const int WeightBits = 8;
+    static QImage::Format format() { return QImage::Format_ARGB32; }
+    static int max() { return 255; }
+    static int channel(QRgb p, int c) { return int((p >> (c == 3 ? 24 : 16 - 8 * c)) & 0xff); } // r, g, b, a
+    static QRgb make(int r, int g, int b, int a) { return qRgba(r, g, b, a); }
+};
+
+// QImage::Format_RGBA64_Premultiplied: 16 bits a channel so repeated
+// resampling does not band; 16-bit weights in 64-bit sums
+template <> struct PixelTraits<QRgba64> {
+    typedef qint64 Accum;
+    static const int WeightBits = 16;
+    static QImage::Format format() { return QImage::Format_RGBA64_Premultiplied; }
+    static int max() { return 65535; }
+    static int channel(QRgba64 p, int c) {
+        return c == 0 ? p.red() : c == 1 ? p.green() : c == 2 ? p.blue() : p.alpha();
+    }
+    static QRgba64 make(int r, int g, int b, int a) { return qRgba64(quint16(r), quint16(g), quint16(b), quint16(a)); }
+};
+
+template <typename Pixel> struct BasicImage {
+    uchar *bits = nullptr;
+    int width = 0, height = 0;
+    int stride = 0; // bytes per row
+
+    Pixel *row(int y) const { return reinterpret_cast<Pixel*>(bits + size_t(y) * stride); }
+    QRect rect() const { return QRect(0, 0, width, height); }
+    bool isNull() const { return !bits; }
+};
+
+template <typename Pixel> struct BasicConstImage {
+    const uchar *bits = nullptr;
+    int width = 0, height = 0;
+    int stride = 0;
+
+    BasicConstImage() {}
+    BasicConstImage(const uchar *b, int w, int h, int s) : bits(b), width(w), height(h), stride(s) {}
+    BasicConstImage(const BasicImage<Pixel> &img) : bits(img.bits), width(img.width), height(img.height), stride(img.stride) {}
+
+    const Pixel *row(int y) const { return reinterpret_cast<const Pixel*>(bits + size_t(y) * stride); }
+    QRect rect() const { return QRect(0, 0, width, height); }
+    bool isNull() const { return !bits; }
+    bool valid(int x, int y) const { return x >= 0 && y >= 0 && x < width && y < height; }
+};
+
+typedef BasicImage<QRgb> Image;
+typedef BasicConstImage<QRgb> ConstImage;
+typedef BasicImage<QRgba64> Image64;
+typedef BasicConstImage<QRgba64> ConstImage64;
+
+// Threads the kernels spread over; 0 or less restores the default (all cores)
+void setThreadCount(int n);
+int threadCount();
+
+// Views of a QImage whose depth matches the pixel type (null otherwise).
+// They do not own the pixels: the image has to outlive them and must not
+// detach or be reassigned while they are in use.
+template <typename Pixel = QRgb> BasicImage<Pixel> view(QImage &img) {
+    BasicImage<Pixel> v;
+    if (img.depth() == int(sizeof(Pixel)) * 8) {
+        v.bits = img.bits();
+        v.width = img.width();
+        v.height = img.height();
+        v.stride = img.bytesPerLine();
+    }
+    return v;
+}
+
+template <typename Pixel = QRgb> BasicConstImage<Pixel> constView(const QImage &img) {
+    if (img.depth() != int(sizeof(Pixel)) * 8)
+        return BasicConstImage<Pixel>();
+    return BasicConstImage<Pixel>(img.constBits(), img.width(), img.height(), img.bytesPerLine());
+}
+
+// Goo brushes
+
+enum BrushType {
+    Brush_Smear,
+    Brush_Grow,
+    Brush_Shrink,
+    Brush_Pinch,
+    Brush_Ungoo
+};
+
+struct Stroke {
+    BrushType brush = Brush_Smear;
+    QPointF location;
+    QPointF direction; // mouse movement since the last dab
+    float radius = 100.0f;
+    float force = 10.0f;
+};
+
+// Bilinear lookup with all four channels mixed, transparent outside
+template <typename Pixel>
+Pixel sampleBilinear(const BasicConstImage<Pixel> &img, float x, float y);
+
+// The pixels a dab can change
+QRect strokeBounds(const Stroke &s, const QRect &image);
+
+// Applies one dab: reads 'src' and writes every pixel of the returned
+// rectangle of 'dst', which must be a separate buffer of the same size.
+// 'original' is only read by Ungoo and may be null otherwise.
+template <typename Pixel>
+QRect warp(const BasicConstImage<Pixel> &src, const BasicConstImage<Pixel> &original, const BasicImage<Pixel> &dst, const Stroke &s);
+
+// Fusion Animation stages. Each writes every pixel of 'dst'; anything that
+// has no source pixel comes out opaque black.
+
+// A with B mixed in at 'blendAmount', B rippled by 'warpAmount' pixels
+template <typename Pixel>
+void blendFusion(const BasicConstImage<Pixel> &a, const BasicConstImage<Pixel> &b, const BasicImage<Pixel> &dst,
+                 float blendAmount, float warpAmount, int time);
+// Animated Julia set in grey
+void fractal(const Image &dst, double zoom, int time);
+// Cuts 'src' into tiles x tiles squares and turns each about its centre
+void tileSpin(const ConstImage &src, const Image &dst, float angleDeg, int tiles);
+// Radial ripple out from the centre
+void goovie(const ConstImage &src, const Image &dst, float strength, int time);
+
+// Draws opaque 'src' over 'dst' at 'opacity', like QPainter::setOpacity
+void composite(const ConstImage &src, const Image &dst, float opacity);
+
+// Fusion Room
+
+// Linear blend of one row: each pixel is the weighted sum of the layers
+// divided by the total weight, in a single pass however many layers there
+// are. 'rows' holds one row per layer and 'weights' 'count' bytes per pixel.
+// No weight at all is an even mix. The result is opaque.
+template <typename Pixel>
+void mixLayers(const Pixel *const *rows, const uchar *weights, int count, int n, Pixel *out);
+
+} // namespace goo
+
+#endif // GOOCORE_H
@@ -0,0 +1,17 @@
+# Include from an app or tool project to build against goocore. The top
+# level goo.pro builds the library first.
+
+QT += concurrent # imageload.cpp
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+GOOCORE_OUT = $$shadowed($$PWD)
+win32:CONFIG(release, debug|release): GOOCORE_OUT = $$GOOCORE_OUT/release
+else:win32:CONFIG(debug, debug|release): GOOCORE_OUT = $$GOOCORE_OUT/debug
+
+LIBS += -L$$GOOCORE_OUT -lgoocore
+win32-g++|!win32: PRE_TARGETDEPS += $$GOOCORE_OUT/libgoocore.a
+else: PRE_TARGETDEPS += $$GOOCORE_OUT/goocore.lib
+
+include(openmp.pri)
@@ -0,0 +1,38 @@
+# Kernels shared by every app and tool; see goocore.h. Link with goocore.pri.
+
+QT       += core gui concurrent
+QT       -= widgets
+
+TEMPLATE = lib
+CONFIG += staticlib c++11 thread optimize_full
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(openmp.pri)
+
+SOURCES += \
+    align.cpp \
+    batch.cpp \
+    goocore.cpp \
+    imageload.cpp \
+    layers.cpp \
+    morph.cpp \
+    pipeline.cpp \
+    pyramid.cpp \
+    sequence.cpp \
+    trace.cpp
+
+HEADERS += \
+    align.h \
+    batch.h \
+    frameview.h \
+    goocore.h \
+    imageload.h \
+    layers.h \
+    morph.h \
+    pipeline.h \
+    pyramid.h \
+    sequence.h \
+    session.h \
+    trace.h \
+    tracetoggle.h
@@ -0,0 +1,81 @@
+#include "imageload.h"
+#include "trace.h"
+#include <QFutureWatcher>
+#include <QImageReader>
+#include <QtConcurrent>
+
+namespace goo {
+
+QSize imageFileSize(const QString &path) {
+    return QImageReader(path).size();
+}
+
+QImage decodeScaled(const QString &path, const QSize &size, QImage::Format format) {
+    GOO_TRACE_SCOPE("decodeScaled");
+    QImageReader reader(path);
+    if (reader.size().isValid())
+        reader.setScaledSize(size);
+    QImage img;
+    if (!reader.read(&img))
+        return QImage();
+    if (img.size() != size)
+        img = img.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    return img.convertToFormat(format);
+}
+
+QFuture<QImage> loadInBackground(const QString &path, QImage::Format format) {
+    return QtConcurrent::run([path, format]() {
+        GOO_TRACE_SCOPE("loadFull");
+        QImage img(path);
+        return img.isNull() ? img : img.convertToFormat(format);
+    });
+}
+
+bool ProxiedImage::open(const QString &path, const std::function<QSize(const QSize &)> &proxySize,
+                        QImage::Format proxyFormat, QImage::Format fullFormat) {
+    GOO_TRACE_SCOPE("openProxied");
+    QSize fileSize = imageFileSize(path);
+    QImage img, shown;
+    if (fileSize.isValid()) {
+        shown = decodeScaled(path, proxySize(fileSize), proxyFormat);
+        if (shown.isNull())
+            return false;
+    } else {
+        // A format that has to be decoded to be measured: all of it now
+        img = QImage(path);
+        if (img.isNull())
+            return false;
+        img = img.convertToFormat(fullFormat);
+        fileSize = img.size();
+        shown = img.scaled(proxySize(fileSize), Qt::IgnoreAspectRatio, Qt::SmoothTransformation).convertToFormat(proxyFormat);
+    }
+    size = fileSize;
+    format = fullFormat;
+    proxyImage = shown;
+    fullImage = img;
+    pending = img.isNull() ? loadInBackground(path, fullFormat) : QFuture<QImage>();
+    return true;
+}
+
+void ProxiedImage::whenLoaded(QObject *context, const std::function<void()> &done) const {
+    if (!loading())
+        return;
+    QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(context);
+    QObject::connect(watcher, &QFutureWatcher<QImage>::finished, context, [watcher, done]() {
+        done();
+        watcher->deleteLater();
+    });
+    watcher->setFuture(pending);
+}
+
+const QImage &ProxiedImage::full() {
+    if (loading()) {
+        fullImage = pending.result();
+        pending = QFuture<QImage>();
+        if (fullImage.isNull()) // the file changed under us; the proxy is all there is
+            fullImage = proxyImage.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation).convertToFormat(format);
+    }
+    return fullImage;
+}
+
+} // namespace goo
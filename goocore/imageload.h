@@ -0,0 +1,65 @@
+#ifndef IMAGELOAD_H
+#define IMAGELOAD_H
+
+#include <QFuture>
+#include <QImage>
+#include <QString>
+#include <functional>
+
+class QObject;
+
+// Opening a photo without waiting for all of it: a screen-sized proxy is
+// decoded first, at that size, while the full image is decoded and
+// converted on the global thread pool for whenever it is needed.
+namespace goo {
+
+// From the file's header alone; invalid if its format cannot tell without
+// decoding the whole image
+QSize imageFileSize(const QString &path);
+
+// 'path' decoded straight at 'size' (the aspect is not kept) and converted
+// to 'format'. JPEG scales while it decodes, so the full image is never held.
+QImage decodeScaled(const QString &path, const QSize &size, QImage::Format format);
+
+// The whole image in 'format'; null in the result if it does not decode
+QFuture<QImage> loadInBackground(const QString &path, QImage::Format format);
+
+// A photo opened the way Goo and Fusion Room open them: the proxy now, the
+// full image once the thread pool has it.
+class ProxiedImage {
+public:
+    // Decodes 'path' at proxySize(size of the file) in 'proxyFormat' and
+    // starts loading all of it in 'fullFormat'. A format that has to be
+    // decoded to be measured is decoded whole here instead, and the proxy
+    // scaled from it. False, leaving this as it was, if it does not decode.
+    bool open(const QString &path, const std::function<QSize(const QSize &)> &proxySize,
+              QImage::Format proxyFormat, QImage::Format fullFormat);
+    void clear() { *this = ProxiedImage(); }
+
+    const QImage &proxy() const { return proxyImage; }
+    QSize fileSize() const { return size; }
+
+    // Whether the full image is still to be taken from the thread pool
+    bool loading() const { return fullImage.isNull() && !proxyImage.isNull(); }
+
+    // The background load, to compare against when it reports in
+    const QFuture<QImage> &fullLoad() const { return pending; }
+
+    // Calls 'done' on 'context''s thread when the background load finishes;
+    // never if there is none or 'context' goes first
+    void whenLoaded(QObject *context, const std::function<void()> &done) const;
+
+    // The full image, waiting for it if it is still loading. If the file no
+    // longer decodes, the proxy scaled to the file's size is all there is.
+    const QImage &full();
+
+private:
+    QSize size;
+    QImage::Format format = QImage::Format_Invalid;
+    QImage proxyImage, fullImage;
+    QFuture<QImage> pending;
+};
+
+} // namespace goo
+
+#endif // IMAGELOAD_H
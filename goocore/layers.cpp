@@ -0,0 +1,236 @@
+#include "layers.h"
+#include "goocore.h"
+#include <QtMath>
+#include <algorithm>
+#include <cstring>
+
+namespace goo {
+
+// Bilinear lookup of all four channels of a mask plane, clamped at the edges
+static inline void sampleWeights(const QImage &plane, QPointF p, uchar *out) {
+    double fx = qBound(0.0, p.x(), plane.width() - 1.0), fy = qBound(0.0, p.y(), plane.height() - 1.0);
+    int x0 = int(fx), y0 = int(fy);
+    int x1 = qMin(x0 + 1, plane.width() - 1), y1 = qMin(y0 + 1, plane.height() - 1);
+    int wx = int((fx - x0) * 256), wy = int((fy - y0) * 256);
+    const uchar *r0 = plane.constScanLine(y0), *r1 = plane.constScanLine(y1);
+    for (int c = 0; c < LayersPerPlane; ++c) {
+        int top = r0[x0 * 4 + c] * (256 - wx) + r0[x1 * 4 + c] * wx;
+        int bottom = r1[x0 * 4 + c] * (256 - wx) + r1[x1 * 4 + c] * wx;
+        out[c] = uchar((top * (256 - wy) + bottom * wy + (1 << 15)) >> 16);
+    }
+}
+
+void fetchLayerRow(const LayerMapping &m, int x0, int y, int n, QRgb *out) {
+    const QImage &img = *m.image;
+    const QTransform &t = m.toSource;
+    const QRgb black = qRgb(0, 0, 0);
+
+    if (t.type() <= QTransform::TxTranslate && t.dx() == qRound(t.dx()) && t.dy() == qRound(t.dy())) {
+        const int sy = y + qRound(t.dy()), sx = x0 + qRound(t.dx());
+        if (sy < 0 || sy >= img.height()) {
+            std::fill(out, out + n, black);
+            return;
+        }
+        const QRgb *row = reinterpret_cast<const QRgb*>(img.constScanLine(sy));
+        for (int i = 0; i < n; ++i)
+            out[i] = (sx + i >= 0 && sx + i < img.width()) ? row[sx + i] : black;
+        return;
+    }
+
+    QPointF p = m.map(x0, y);
+    const QPointF step(t.m11(), t.m12()); // one canvas pixel to the right
+    for (int i = 0; i < n; ++i, p += step)
+        out[i] = sampleLayer(img, p);
+}
+
+void compositeTile(const QVector<LayerMapping> &layers, const QVector<QImage> &planes, const QTransform &maskMap,
+                   const QRect &tile, uchar *out, int outStride) {
+    const int count = layers.size(), n = tile.width();
+    std::vector<QRgb> fetched(size_t(n) * (count + 1));
+    std::vector<uchar> weights(size_t(n) * count);
+    const QRgb *rows[MaxLayers];
+    for (int k = 0; k < count; ++k)
+        rows[k] = &fetched[size_t(k) * n];
+    QRgb *mixed = &fetched[size_t(count) * n];
+    LayerMapping m;
+    m.toSource = maskMap;
+
+    for (int y = tile.top(); y <= tile.bottom(); ++y) {
+        for (int k = 0; k < count; ++k)
+            fetchLayerRow(layers[k], tile.left(), y, n, &fetched[size_t(k) * n]);
+        for (int x = 0; x < n; ++x) {
+            uchar w[MaxLayers / LayersPerPlane * LayersPerPlane];
+            for (int i = 0; i < planes.size(); ++i)
+                sampleWeights(planes[i], m.map(tile.left() + x, y), w + i * LayersPerPlane);
+            memcpy(&weights[size_t(x) * count], w, count);
+        }
+        mixLayers(rows, weights.data(), count, n, mixed);
+
+        uchar *dst = out + size_t(y - tile.top()) * outStride;
+        for (int x = 0; x < n; ++x) {
+            *dst++ = uchar(qRed(mixed[x]));
+            *dst++ = uchar(qGreen(mixed[x]));
+            *dst++ = uchar(qBlue(mixed[x]));
+        }
+    }
+}
+
+QRect paintWeights(QVector<QImage> &planes, int layer, int count, QPoint center, float radius) {
+    const int r = qCeil(radius);
+    QRect dab = QRect(center - QPoint(r, r), center + QPoint(r, r)).intersected(planes.first().rect());
+    for (int y = dab.top(); y <= dab.bottom(); ++y) {
+        uchar *rows[MaxLayers / LayersPerPlane];
+        for (int i = 0; i < planes.size(); ++i)
+            rows[i] = planes[i].scanLine(y);
+        float dy = y - center.y();
+        for (int x = dab.left(); x <= dab.right(); ++x) {
+            float dx = x - center.x();
+            float f = 1.0f - qSqrt(dx * dx + dy * dy) / radius;
+            if (f <= 0)
+                continue;
+            const int amount = qRound(f * 256);
+            for (int k = 0; k < count; ++k) {
+                uchar &w = rows[k / LayersPerPlane][x * LayersPerPlane + k % LayersPerPlane];
+                const int target = (k == layer) ? 255 : 0;
+                w = uchar(w + (((target - w) * amount + 128) >> 8));
+            }
+        }
+    }
+    return dab;
+}
+
+void MaskBlur::boxPass(int *p, int n, int stride, int r, int *tmp) {
+    for (int i = 0; i < n; ++i)
+        tmp[i] = p[i * stride];
+
+    const int win = 2 * r + 1;
+    int sum = tmp[0] * (r + 1); // window [-r, r], edges clamped
+    for (int i = 1; i <= r; ++i)
+        sum += tmp[qMin(i, n - 1)];
+
+    for (int i = 0; i < n; ++i) {
+        p[i * stride] = (sum + win / 2) / win;
+        sum += tmp[qMin(i + r + 1, n - 1)] - tmp[qMax(i - r, 0)];
+    }
+}
+
+QRect MaskBlur::apply(QImage &mask, QPoint center, float radius, float strength) {
+    const int ch = mask.depth() / 8;
+    const int r = qCeil(radius);
+    const int blurRadius = qMax(1, r / 4);
+    const int passes = 3;
+
+    QRect dab = QRect(center - QPoint(r, r), center + QPoint(r, r)).intersected(mask.rect());
+    if (dab.isEmpty())
+        return QRect();
+    const int pad = blurRadius * passes;
+    QRect region = dab.adjusted(-pad, -pad, pad, pad).intersected(mask.rect());
+    const int w = region.width(), h = region.height();
+
+    if (work.size() < size_t(w) * h * ch)
+        work.resize(size_t(w) * h * ch);
+    if (line.size() < size_t(qMax(w, h)))
+        line.resize(qMax(w, h));
+
+    for (int y = 0; y < h; ++y) {
+        const uchar *src = mask.constScanLine(region.top() + y) + region.left() * ch;
+        int *dst = &work[size_t(y) * w * ch];
+        for (int i = 0; i < w * ch; ++i)
+            dst[i] = src[i] << 8;
+    }
+
+    for (int c = 0; c < ch; ++c) {
+        for (int pass = 0; pass < passes; ++pass) {
+            for (int y = 0; y < h; ++y)
+                boxPass(&work[size_t(y) * w * ch + c], w, ch, blurRadius, line.data());
+            for (int x = 0; x < w; ++x)
+                boxPass(&work[size_t(x) * ch + c], h, w * ch, blurRadius, line.data());
+        }
+    }
+
+    // Feather: (1 - d²/r²)² falls off smoothly to zero at the rim
+    const float invR2 = 1.0f / (radius * radius);
+    const int amount = qRound(qBound(0.0f, strength, 1.0f) * 256);
+    for (int y = dab.top(); y <= dab.bottom(); ++y) {
+        uchar *row = mask.scanLine(y);
+        const int *blurred = &work[size_t(y - region.top()) * w * ch];
+        float dy = y - center.y();
+        for (int x = dab.left(); x <= dab.right(); ++x) {
+            float dx = x - center.x();
+            float f = 1.0f - (dx * dx + dy * dy) * invR2;
+            if (f <= 0)
+                continue;
+            int wgt = qRound(f * f * amount); // 0–256
+            uchar *px = row + x * ch;
+            const int *b = blurred + (x - region.left()) * ch;
+            for (int c = 0; c < ch; ++c) {
+                int v = px[c] << 8;
+                px[c] = uchar((v + (((b[c] - v) * wgt) >> 8) + 128) >> 8);
+            }
+        }
+    }
+    return dab;
+}
+
+QRect MaskSmear::step(QImage &mask, QPointF center, QPointF delta, float radius, float strength) {
+    const int ch = mask.depth() / 8;
+    const int r = qCeil(radius);
+    QPoint c = center.toPoint();
+    QRect dab = QRect(c - QPoint(r, r), c + QPoint(r, r)).intersected(mask.rect());
+    if (dab.isEmpty())
+        return QRect();
+
+    const int reach = qCeil(qMax(qAbs(delta.x()), qAbs(delta.y()))) + 1;
+    QRect src = dab.adjusted(-reach, -reach, reach, reach).intersected(mask.rect());
+    const int sw = src.width(), sh = src.height();
+    if (snapshot.size() < size_t(sw) * sh * ch)
+        snapshot.resize(size_t(sw) * sh * ch);
+    for (int y = 0; y < sh; ++y)
+        memcpy(&snapshot[size_t(y) * sw * ch], mask.constScanLine(src.top() + y) + src.left() * ch, size_t(sw) * ch);
+
+    const float invR2 = 1.0f / (radius * radius);
+    const float k = qBound(0.0f, strength, 1.0f);
+    for (int y = dab.top(); y <= dab.bottom(); ++y) {
+        uchar *row = mask.scanLine(y);
+        float dy = y - center.y();
+        for (int x = dab.left(); x <= dab.right(); ++x) {
+            float dx = x - center.x();
+            float f = 1.0f - (dx * dx + dy * dy) * invR2;
+            if (f <= 0)
+                continue;
+            f = f * f * k;
+
+            // Source position relative to the snapshot, clamped to it
+            float sx = qBound(0.0f, float(x - delta.x() * f - src.left()), float(sw - 1));
+            float sy = qBound(0.0f, float(y - delta.y() * f - src.top()), float(sh - 1));
+            int x0 = int(sx), y0 = int(sy);
+            int x1 = qMin(x0 + 1, sw - 1), y1 = qMin(y0 + 1, sh - 1);
+            int fx = int((sx - x0) * 256), fy = int((sy - y0) * 256);
+
+            const uchar *p00 = &snapshot[(size_t(y0) * sw + x0) * ch];
+            const uchar *p10 = &snapshot[(size_t(y0) * sw + x1) * ch];
+            const uchar *p01 = &snapshot[(size_t(y1) * sw + x0) * ch];
+            const uchar *p11 = &snapshot[(size_t(y1) * sw + x1) * ch];
+            uchar *px = row + x * ch;
+            for (int i = 0; i < ch; ++i) {
+                int top = (p00[i] << 8) + (p10[i] - p00[i]) * fx;
+                int bottom = (p01[i] << 8) + (p11[i] - p01[i]) * fx;
+                px[i] = uchar(((top << 8) + (bottom - top) * fy + (1 << 15)) >> 16);
+            }
+        }
+    }
+    return dab;
+}
+
+QRect MaskSmear::apply(QImage &mask, QPointF from, QPointF to, float radius, float strength) {
+    QPointF delta = to - from;
+    int steps = qMax(1, qCeil(qMax(qAbs(delta.x()), qAbs(delta.y())) / qMax(1.0f, radius * 0.25f)));
+    QPointF stepDelta = delta / steps;
+
+    QRect dirty;
+    for (int i = 1; i <= steps; ++i)
+        dirty |= step(mask, from + stepDelta * i, stepDelta, radius, strength);
+    return dirty;
+}
+
+} // namespace goo
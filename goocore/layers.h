@@ -0,0 +1,124 @@
+#ifndef LAYERS_H
+#define LAYERS_H
+
+#include <QImage>
+#include <QRect>
+#include <QTransform>
+#include <QVector>
+#include <vector>
+
+// Fusion Room's layer stack: sources placed on a canvas by a transform that
+// is applied while sampling, their weights, and the brushes that paint
+// them. The editor, its export and the headless batch all blend through
+// these; none of it needs a widget.
+namespace goo {
+
+// Layer weights are packed four to an RGBA8888 mask plane: layer k lives in
+// byte k % 4 of plane k / 4.
+static const int MaxLayers = 8;
+static const int LayersPerPlane = 4;
+
+// How a source sits on the canvas: mirrored, scaled and rotated about its
+// centre, then moved. It is applied while sampling and never baked into the
+// source, so flips are free and moves can be subpixel.
+struct LayerTransform {
+    bool flipH = false, flipV = false;
+    double rotation = 0; // degrees, clockwise
+    double scale = 1;
+    QPointF translate;   // canvas pixels
+
+    // Source -> canvas, continuous coordinates, for a source of 'size'
+    QTransform toCanvas(QSizeF size) const {
+        const double cx = size.width() / 2, cy = size.height() / 2;
+        QTransform t;
+        t.translate(translate.x() + cx, translate.y() + cy);
+        t.rotate(rotation);
+        t.scale(flipH ? -scale : scale, flipV ? -scale : scale);
+        t.translate(-cx, -cy);
+        return t;
+    }
+};
+
+// Where a source's pixels land on a canvas. 'toSource' takes continuous
+// canvas coordinates to continuous source coordinates, so the mapping holds
+// at any output size; map() converts between pixel centres.
+struct LayerMapping {
+    const QImage *image = nullptr;
+    QTransform toSource;
+
+    QPointF map(int x, int y) const {
+        return toSource.map(QPointF(x + 0.5, y + 0.5)) - QPointF(0.5, 0.5);
+    }
+};
+
+// Bilinear 32-bit lookup, black outside the image like the proxy blend.
+// Inline: the morph and the aligner call it for every pixel.
+inline QRgb sampleLayer(const QImage &img, QPointF p) {
+    const int w = img.width(), h = img.height();
+    if (p.x() < -0.5 || p.y() < -0.5 || p.x() > w - 0.5 || p.y() > h - 0.5)
+        return qRgb(0, 0, 0);
+
+    double fx = qBound(0.0, p.x(), w - 1.0), fy = qBound(0.0, p.y(), h - 1.0);
+    int x0 = int(fx), y0 = int(fy);
+    int x1 = qMin(x0 + 1, w - 1), y1 = qMin(y0 + 1, h - 1);
+    int wx = int((fx - x0) * 256), wy = int((fy - y0) * 256);
+
+    const QRgb *r0 = reinterpret_cast<const QRgb*>(img.constScanLine(y0));
+    const QRgb *r1 = reinterpret_cast<const QRgb*>(img.constScanLine(y1));
+    QRgb c00 = r0[x0], c10 = r0[x1], c01 = r1[x0], c11 = r1[x1];
+    auto mix = [&](int shift) {
+        int top = int((c00 >> shift) & 0xff) * (256 - wx) + int((c10 >> shift) & 0xff) * wx;
+        int bottom = int((c01 >> shift) & 0xff) * (256 - wx) + int((c11 >> shift) & 0xff) * wx;
+        return (top * (256 - wy) + bottom * wy + (1 << 15)) >> 16;
+    };
+    return qRgb(mix(16), mix(8), mix(0));
+}
+
+// Canvas pixels x0 .. x0 + n - 1 of row y of a layer. Whole-pixel moves
+// copy straight from the source, anything else is sampled bilinearly.
+void fetchLayerRow(const LayerMapping &m, int x0, int y, int n, QRgb *out);
+
+// Linear blend of one tile of a canvas into packed RGB rows. All mask planes
+// share 'maskMap', canvas -> plane. 'out' points at the first pixel of the
+// tile's first row. Tiles may be blended from several threads at once.
+void compositeTile(const QVector<LayerMapping> &layers, const QVector<QImage> &planes, const QTransform &maskMap,
+                   const QRect &tile, uchar *out, int outStride);
+
+// Paint brush: under a dab with a linear falloff, pulls one layer's weight
+// toward full and every other layer's toward zero. Returns the changed rect.
+QRect paintWeights(QVector<QImage> &planes, int layer, int count, QPoint center, float radius);
+
+// Smooth brush: an in-place blur of the mask under a round, feathered dab.
+// Three running-sum box passes per axis approximate a Gaussian, so the cost
+// per pixel doesn't grow with the radius. Works on any 8-bit interleaved
+// plane, and the scratch buffers only ever grow, so after the first few dabs
+// it no longer allocates.
+class MaskBlur {
+    std::vector<int> work; // region being blurred, values in 8.8 fixed point
+    std::vector<int> line; // copy of the row/column a box pass reads from
+
+    static void boxPass(int *p, int n, int stride, int r, int *tmp);
+
+public:
+    // Blurs 'mask' under a dab of 'radius' at 'center'. 'strength' is how far
+    // the dab centre moves toward the blurred value. Returns the changed rect.
+    QRect apply(QImage &mask, QPoint center, float radius, float strength);
+};
+
+// Smear brush: pushes mask values along the stroke. Each pixel under the dab
+// pulls from 'delta * falloff' behind it with bilinear sampling, reading from
+// a snapshot of the region so the dab doesn't feed on its own output. Long
+// mouse moves are split into steps of a quarter radius.
+class MaskSmear {
+    std::vector<uchar> snapshot;
+
+    QRect step(QImage &mask, QPointF center, QPointF delta, float radius, float strength);
+
+public:
+    // Smears 'mask' along the stroke from 'from' to 'to'. Returns the changed rect.
+    QRect apply(QImage &mask, QPointF from, QPointF to, float radius, float strength);
+};
+
+} // namespace goo
+
+#endif // LAYERS_H
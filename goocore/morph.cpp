@@ -0,0 +1,164 @@
+#include "morph.h"
+#include "layers.h"
+#include <QtConcurrent>
+#include <QtMath>
+#include <atomic>
+
+namespace goo {
+
+struct MorphTriangle {
+    int v[3];
+};
+
+// Bowyer-Watson. Fine for the few dozen points a user places by hand.
+static QVector<MorphTriangle> delaunay(const QVector<QPointF> &pts) {
+    struct Tri {
+        int v[3];
+        QPointF centre;
+        double r2;
+    };
+    QVector<QPointF> p = pts;
+    QRectF bounds;
+    for (const QPointF &q : pts)
+        bounds |= QRectF(q, QSizeF(1, 1));
+    const double span = qMax(bounds.width(), bounds.height()) * 20 + 1;
+    const QPointF mid = bounds.center();
+    const int n = pts.size();
+    p << QPointF(mid.x() - span, mid.y() - span) << QPointF(mid.x() + span, mid.y() - span)
+      << QPointF(mid.x(), mid.y() + span);
+
+    auto makeTri = [&](int a, int b, int c) {
+        Tri t = {{a, b, c}, QPointF(), -1};
+        const QPointF &A = p[a], &B = p[b], &C = p[c];
+        double d = 2 * (A.x() * (B.y() - C.y()) + B.x() * (C.y() - A.y()) + C.x() * (A.y() - B.y()));
+        if (qAbs(d) < 1e-12)
+            return t; // degenerate, never contains anything
+        double a2 = A.x() * A.x() + A.y() * A.y();
+        double b2 = B.x() * B.x() + B.y() * B.y();
+        double c2 = C.x() * C.x() + C.y() * C.y();
+        t.centre = QPointF((a2 * (B.y() - C.y()) + b2 * (C.y() - A.y()) + c2 * (A.y() - B.y())) / d,
+                           (a2 * (C.x() - B.x()) + b2 * (A.x() - C.x()) + c2 * (B.x() - A.x())) / d);
+        QPointF e = A - t.centre;
+        t.r2 = e.x() * e.x() + e.y() * e.y();
+        return t;
+    };
+
+    QVector<Tri> tris;
+    tris.append(makeTri(n, n + 1, n + 2));
+    for (int i = 0; i < n; ++i) {
+        QVector<QPair<int, int>> edges;
+        QVector<Tri> keep;
+        for (const Tri &t : tris) {
+            QPointF e = p[i] - t.centre;
+            if (t.r2 >= 0 && e.x() * e.x() + e.y() * e.y() < t.r2) {
+                for (int k = 0; k < 3; ++k)
+                    edges.append(qMakePair(t.v[k], t.v[(k + 1) % 3]));
+            } else {
+                keep.append(t);
+            }
+        }
+        // The cavity's boundary is every edge only one removed triangle had
+        for (int k = 0; k < edges.size(); ++k) {
+            bool shared = false;
+            for (int j = 0; j < edges.size() && !shared; ++j)
+                shared = j != k && edges[j].first == edges[k].second && edges[j].second == edges[k].first;
+            if (!shared)
+                keep.append(makeTri(edges[k].first, edges[k].second, i));
+        }
+        tris = keep;
+    }
+
+    QVector<MorphTriangle> out;
+    for (const Tri &t : tris) {
+        if (t.v[0] >= n || t.v[1] >= n || t.v[2] >= n || t.r2 < 0)
+            continue;
+        MorphTriangle m = {{t.v[0], t.v[1], t.v[2]}};
+        out.append(m);
+    }
+    return out;
+}
+
+// Renders the frame at blend position 't'. 'shape' holds its frame-space
+// points and 'tris' the shared mesh.
+static QImage renderMorphFrame(const MorphSequence &seq, const QVector<MorphTriangle> &tris,
+                               const QVector<QPointF> &shape, double t) {
+    QImage frame(seq.frameSize, QImage::Format_ARGB32);
+    frame.fill(Qt::black);
+    const int mixB = qRound(t * 256);
+
+    for (const MorphTriangle &tri : tris) {
+        const QPointF &P0 = shape[tri.v[0]], &P1 = shape[tri.v[1]], &P2 = shape[tri.v[2]];
+        const double det = (P1.x() - P0.x()) * (P2.y() - P0.y()) - (P2.x() - P0.x()) * (P1.y() - P0.y());
+        if (qAbs(det) < 1e-9)
+            continue; // collapsed this frame
+
+        // Frame position -> barycentric weights of P1 and P2, then straight
+        // into each source: src = S0 + u * (S1 - S0) + v * (S2 - S0)
+        const QPointF A0 = seq.ptsA[tri.v[0]], dA1 = seq.ptsA[tri.v[1]] - A0, dA2 = seq.ptsA[tri.v[2]] - A0;
+        const QPointF B0 = seq.ptsB[tri.v[0]], dB1 = seq.ptsB[tri.v[1]] - B0, dB2 = seq.ptsB[tri.v[2]] - B0;
+
+        const int x0 = qMax(0, qFloor(qMin(P0.x(), qMin(P1.x(), P2.x()))));
+        const int x1 = qMin(frame.width() - 1, qCeil(qMax(P0.x(), qMax(P1.x(), P2.x()))));
+        const int y0 = qMax(0, qFloor(qMin(P0.y(), qMin(P1.y(), P2.y()))));
+        const int y1 = qMin(frame.height() - 1, qCeil(qMax(P0.y(), qMax(P1.y(), P2.y()))));
+        const double eps = -1e-6;
+
+        for (int y = y0; y <= y1; ++y) {
+            QRgb *out = reinterpret_cast<QRgb*>(frame.scanLine(y));
+            const double py = y + 0.5 - P0.y();
+            for (int x = x0; x <= x1; ++x) {
+                const double px = x + 0.5 - P0.x();
+                const double u = (px * (P2.y() - P0.y()) - py * (P2.x() - P0.x())) / det;
+                const double v = (py * (P1.x() - P0.x()) - px * (P1.y() - P0.y())) / det;
+                if (u < eps || v < eps || u + v > 1 - eps)
+                    continue;
+
+                QPointF sa = A0 + u * dA1 + v * dA2 - QPointF(0.5, 0.5);
+                QPointF sb = B0 + u * dB1 + v * dB2 - QPointF(0.5, 0.5);
+                QRgb cA = sampleLayer(seq.a, sa);
+                QRgb cB = sampleLayer(seq.b, sb);
+                out[x] = qRgb((qRed(cA)   * (256 - mixB) + qRed(cB)   * mixB + 128) >> 8,
+                              (qGreen(cA) * (256 - mixB) + qGreen(cB) * mixB + 128) >> 8,
+                              (qBlue(cA)  * (256 - mixB) + qBlue(cB)  * mixB + 128) >> 8);
+            }
+        }
+    }
+    return frame;
+}
+
+bool renderMorphSequence(const MorphSequence &seq) {
+    if (seq.ptsA.size() != seq.ptsB.size() || seq.frames < 2 || seq.a.isNull() || seq.b.isNull())
+        return false;
+
+    // Geometry of every frame, in frame pixels. B is stretched over the
+    // frame so the source corners always meet.
+    const double ax = double(seq.frameSize.width()) / seq.a.width(), ay = double(seq.frameSize.height()) / seq.a.height();
+    const double bx = double(seq.frameSize.width()) / seq.b.width(), by = double(seq.frameSize.height()) / seq.b.height();
+    QVector<QVector<QPointF>> shapes(seq.frames);
+    for (int f = 0; f < seq.frames; ++f) {
+        const double t = double(f) / (seq.frames - 1);
+        for (int i = 0; i < seq.ptsA.size(); ++i) {
+            QPointF pa(seq.ptsA[i].x() * ax, seq.ptsA[i].y() * ay);
+            QPointF pb(seq.ptsB[i].x() * bx, seq.ptsB[i].y() * by);
+            shapes[f].append(pa * (1 - t) + pb * t);
+        }
+    }
+
+    QVector<QPointF> halfway;
+    for (int i = 0; i < seq.ptsA.size(); ++i)
+        halfway.append((shapes.first()[i] + shapes.last()[i]) / 2);
+    const QVector<MorphTriangle> tris = delaunay(halfway);
+
+    QVector<int> indices;
+    for (int f = 0; f < seq.frames; ++f)
+        indices.append(f);
+    std::atomic<bool> ok(true);
+    QtConcurrent::blockingMap(indices, [&](int f) {
+        QImage frame = renderMorphFrame(seq, tris, shapes[f], double(f) / (seq.frames - 1));
+        if (!frame.save(seq.pattern.arg(f, 4, 10, QChar('0'))))
+            ok = false;
+    });
+    return ok;
+}
+
+} // namespace goo
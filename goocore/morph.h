@@ -0,0 +1,33 @@
+#ifndef MORPH_H
+#define MORPH_H
+
+#include <QImage>
+#include <QPointF>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+namespace goo {
+
+// Feature-point morph. Both sources are warped toward geometry interpolated
+// between matching points and cross-dissolved. The mesh is one Delaunay
+// triangulation of the halfway shape shared by every frame, so a frame only
+// needs three affine maps per triangle.
+struct MorphSequence {
+    QImage a, b;              // 32-bit sources; alpha is ignored
+    QVector<QPointF> ptsA;    // feature points in A's pixel space, continuous
+    QVector<QPointF> ptsB;    // the matching points in B's
+    QSize frameSize;
+    int frames = 2;
+    QString pattern;          // QString::arg() pattern for the frame paths
+};
+
+// Renders the whole sequence on all cores. Each frame is written as soon as
+// it is finished, so memory use is a frame per worker however long the
+// sequence is. False if the points do not pair up, a source is missing or a
+// frame could not be written.
+bool renderMorphSequence(const MorphSequence &seq);
+
+} // namespace goo
+
+#endif // MORPH_H
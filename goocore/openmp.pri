@@ -0,0 +1,12 @@
+# OpenMP for the kernels' parallel loops. Apple clang has no driver flag for
+# it and needs libomp from Homebrew (the brew paths in the app projects).
+msvc {
+    QMAKE_CXXFLAGS += -openmp
+} else:macx {
+    QMAKE_CXXFLAGS += -Xpreprocessor -fopenmp
+    INCLUDEPATH += /Users/macbook2015/Desktop/brew/include
+    LIBS += -L/Users/macbook2015/Desktop/brew/lib -lomp
+} else {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
@@ -0,0 +1,58 @@
+#include "pipeline.h"
+#include "trace.h"
+#include <QElapsedTimer>
+#include <algorithm>
+
+namespace goo {
+
+const char *FusionPipeline::stageName(int stage) {
+    static const char *const names[StageCount] = { "blend", "fractal", "tileSpin", "composite", "goovie" };
+    return stage >= 0 && stage < StageCount ? names[stage] : "";
+}
+
+const QImage &FusionPipeline::render(const QImage &a, const QImage &b, const Params &p, int time, qint64 *nsecs) {
+    GOO_TRACE_SCOPE("frame");
+    const QSize size = a.size();
+    if (out.size() != size) {
+        fused = QImage(size, QImage::Format_RGB32);
+        spun = QImage(size, QImage::Format_RGB32);
+        combo = QImage(size, QImage::Format_RGB32);
+        out = QImage(size, QImage::Format_ARGB32_Premultiplied); // every pixel is opaque, so the same bits
+    }
+
+    // Each stage also becomes a span of its own when tracing
+    const bool tracing = trace::enabled();
+    qint64 mark = tracing ? trace::now() : 0;
+    QElapsedTimer clock;
+    auto lap = [&](Stage s) {
+        if (nsecs)
+            nsecs[s] = clock.nsecsElapsed();
+        clock.restart();
+        if (tracing) {
+            const qint64 t = trace::now();
+            trace::record(stageName(s), mark, t);
+            mark = t;
+        }
+    };
+    if (nsecs)
+        std::fill(nsecs, nsecs + StageCount, 0);
+    clock.start();
+
+    blendFusion(constView(a), constView(b), view(fused), p.blend, p.warp, time);
+    lap(Stage_Blend);
+    if (p.fractal) {
+        fractal(view(combo), p.zoom, time);
+        lap(Stage_Fractal);
+    }
+    tileSpin(constView(fused), view(spun), p.spin + time, p.tiles);
+    lap(Stage_TileSpin);
+    if (!p.fractal)
+        combo.fill(Qt::black); // counted with the composite
+    composite(constView(spun), view(combo), p.opacity);
+    lap(Stage_Composite);
+    goovie(constView(combo), view(out), p.warp, time);
+    lap(Stage_Goovie);
+    return out;
+}
+
+} // namespace goo
@@ -0,0 +1,49 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "goocore.h"
+#include <QImage>
+
+namespace goo {
+
+// One Fusion Animation frame: A and B blended, cut into spinning tiles,
+// laid over the fractal (or black) and rippled. It owns one buffer per
+// stage, so once the size settles a frame allocates nothing. Fusion
+// Animation and fusionbench both render through this.
+class FusionPipeline {
+public:
+    enum Stage {
+        Stage_Blend,
+        Stage_Fractal,
+        Stage_TileSpin,
+        Stage_Composite,
+        Stage_Goovie,
+        StageCount
+    };
+    static const char *stageName(int stage);
+
+    struct Params {
+        float blend = 0;   // 0 .. 1
+        float warp = 0;    // pixels
+        float spin = 0;    // degrees, on top of one per frame
+        double zoom = 1;
+        bool fractal = false;
+        int tiles = 4;
+        float opacity = 0.7f;
+    };
+
+    // Renders frame 'time' at the size of A, which B has to match. With
+    // 'nsecs' set, it receives the time of each stage (0 for skipped ones).
+    // The frame is an opaque Format_ARGB32_Premultiplied image, ready for
+    // the screen as it is, and stays at the same address between calls.
+    const QImage &render(const QImage &a, const QImage &b, const Params &p, int time, qint64 *nsecs = nullptr);
+
+    const QImage &frame() const { return out; }
+
+private:
+    QImage fused, spun, combo, out;
+};
+
+} // namespace goo
+
+#endif // PIPELINE_H
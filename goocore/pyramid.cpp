@@ -0,0 +1,208 @@
+#include "pyramid.h"
+#include "layers.h"
+
+namespace goo {
+
+// 5-tap binomial [1 4 6 4 1] / 16, edges clamped
+void PyramidBlender::reduce(const std::vector<float> &src, int sw, int sh,
+                            std::vector<float> &dst, int dw, int ch, const QRect &area) {
+    static const float k[5] = { 1 / 16.f, 4 / 16.f, 6 / 16.f, 4 / 16.f, 1 / 16.f };
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        for (int x = area.left(); x <= area.right(); ++x) {
+            float acc[MaxLayers] = {};
+            for (int j = 0; j < 5; ++j) {
+                int sy = qBound(0, 2 * y + j - 2, sh - 1);
+                for (int i = 0; i < 5; ++i) {
+                    int sx = qBound(0, 2 * x + i - 2, sw - 1);
+                    const float *s = &src[(sy * sw + sx) * ch];
+                    float w = k[i] * k[j];
+                    for (int c = 0; c < ch; ++c)
+                        acc[c] += s[c] * w;
+                }
+            }
+            float *d = &dst[(y * dw + x) * ch];
+            for (int c = 0; c < ch; ++c)
+                d[c] = acc[c];
+        }
+    }
+}
+
+// Taps of the expand filter along one axis: even outputs hit three coarse
+// samples (1/8, 6/8, 1/8), odd outputs sit between two (1/2, 1/2).
+int PyramidBlender::expandTaps(int x, int n, int *idx, float *w) {
+    if (x % 2 == 0) {
+        idx[0] = qMax(x / 2 - 1, 0);     w[0] = 1 / 8.f;
+        idx[1] = qMin(x / 2, n - 1);     w[1] = 6 / 8.f;
+        idx[2] = qMin(x / 2 + 1, n - 1); w[2] = 1 / 8.f;
+        return 3;
+    }
+    idx[0] = qMin((x - 1) / 2, n - 1); w[0] = 0.5f;
+    idx[1] = qMin((x + 1) / 2, n - 1); w[1] = 0.5f;
+    return 2;
+}
+
+void PyramidBlender::expandAt(const std::vector<float> &src, int sw, int sh, int x, int y, float *out) {
+    int ix[3], iy[3];
+    float wx[3], wy[3];
+    int nx = expandTaps(x, sw, ix, wx);
+    int ny = expandTaps(y, sh, iy, wy);
+    out[0] = out[1] = out[2] = 0;
+    for (int j = 0; j < ny; ++j) {
+        for (int i = 0; i < nx; ++i) {
+            const float *s = &src[(iy[j] * sw + ix[i]) * 3];
+            float w = wx[i] * wy[j];
+            out[0] += s[0] * w;
+            out[1] += s[1] * w;
+            out[2] += s[2] * w;
+        }
+    }
+}
+
+void PyramidBlender::buildLaplacian(const QImage &img, std::vector<Level> &lv, int source) {
+    std::vector<float> gauss(size_t(lv[0].w) * lv[0].h * 3);
+    for (int y = 0; y < lv[0].h; ++y) {
+        const QRgb *row = reinterpret_cast<const QRgb*>(img.constScanLine(y));
+        for (int x = 0; x < lv[0].w; ++x) {
+            float *g = &gauss[(y * lv[0].w + x) * 3];
+            g[0] = qRed(row[x]);
+            g[1] = qGreen(row[x]);
+            g[2] = qBlue(row[x]);
+        }
+    }
+
+    for (size_t l = 0; l < lv.size(); ++l) {
+        Level &cur = lv[l];
+        std::vector<float> &lap = cur.lap[source];
+        if (l + 1 == lv.size()) {
+            lap = std::move(gauss); // coarsest band is the Gaussian residual
+            break;
+        }
+        const Level &next = lv[l + 1];
+        std::vector<float> coarse(size_t(next.w) * next.h * 3);
+        reduce(gauss, cur.w, cur.h, coarse, next.w, 3, QRect(0, 0, next.w, next.h));
+
+        lap.resize(gauss.size());
+        float e[3];
+        for (int y = 0; y < cur.h; ++y) {
+            for (int x = 0; x < cur.w; ++x) {
+                expandAt(coarse, next.w, next.h, x, y, e);
+                size_t i = size_t(y * cur.w + x) * 3;
+                lap[i]     = gauss[i]     - e[0];
+                lap[i + 1] = gauss[i + 1] - e[1];
+                lap[i + 2] = gauss[i + 2] - e[2];
+            }
+        }
+        gauss = std::move(coarse);
+    }
+}
+
+void PyramidBlender::setSources(const QVector<QImage> &sources) {
+    levels.clear();
+    count = sources.size();
+    if (sources.isEmpty())
+        return;
+    int w = sources.first().width(), h = sources.first().height();
+    while (levels.size() < size_t(MaxLevels)) {
+        Level l;
+        l.w = w;
+        l.h = h;
+        l.lap.resize(count);
+        l.mask.resize(size_t(w) * h * count);
+        l.out.resize(size_t(w) * h * 3);
+        levels.push_back(std::move(l));
+        if (qMin(w, h) <= 16)
+            break;
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+    for (int k = 0; k < count; ++k)
+        buildLaplacian(sources[k], levels, k);
+}
+
+void PyramidBlender::setSource(int k, const QImage &source) {
+    if (k < count && !levels.empty())
+        buildLaplacian(source, levels, k);
+}
+
+QRect PyramidBlender::update(const QVector<QImage> &planes, const QRect &area, QImage &fusion) {
+    if (levels.empty())
+        return QRect();
+
+    // Walk down: the Gaussian weights that changed at each level
+    std::vector<QRect> maskDirty(levels.size());
+    QRect r = area.intersected(QRect(0, 0, levels[0].w, levels[0].h));
+    for (int y = r.top(); y <= r.bottom(); ++y) {
+        const uchar *rows[MaxLayers / LayersPerPlane];
+        for (int i = 0; i < planes.size(); ++i)
+            rows[i] = planes[i].constScanLine(y);
+        float *dst = &levels[0].mask[size_t(y) * levels[0].w * count];
+        for (int x = r.left(); x <= r.right(); ++x) {
+            float *w = dst + x * count;
+            int sum = 0;
+            for (int k = 0; k < count; ++k)
+                sum += (w[k] = rows[k / LayersPerPlane][x * LayersPerPlane + k % LayersPerPlane]);
+            for (int k = 0; k < count; ++k)
+                w[k] = sum ? w[k] / sum : 1.0f / count; // no weight at all is an even mix
+        }
+    }
+    maskDirty[0] = r;
+    for (size_t l = 1; l < levels.size() && !r.isEmpty(); ++l) {
+        const Level &fine = levels[l - 1];
+        Level &cur = levels[l];
+        // Coarse x reads fine 2x - 2 .. 2x + 2
+        QRect down(QPoint(qMax(r.left() - 1, 0) / 2, qMax(r.top() - 1, 0) / 2),
+                   QPoint((r.right() + 2) / 2, (r.bottom() + 2) / 2));
+        r = down.intersected(QRect(0, 0, cur.w, cur.h));
+        reduce(fine.mask, fine.w, fine.h, cur.mask, cur.w, count, r);
+        maskDirty[l] = r;
+    }
+
+    // Walk up: collapse only where the mask or a coarser result changed
+    QRect up;
+    for (int l = int(levels.size()) - 1; l >= 0; --l) {
+        Level &cur = levels[l];
+        QRect dirty = maskDirty[l];
+        if (!up.isEmpty()) // fine x reads coarse x / 2 - 1 .. x / 2 + 1
+            dirty |= QRect(QPoint(up.left() * 2 - 2, up.top() * 2 - 2),
+                           QPoint(up.right() * 2 + 2, up.bottom() * 2 + 2));
+        dirty = dirty.intersected(QRect(0, 0, cur.w, cur.h));
+
+        const Level *coarse = (l + 1 < int(levels.size())) ? &levels[l + 1] : nullptr;
+        float e[3] = { 0, 0, 0 };
+        for (int y = dirty.top(); y <= dirty.bottom(); ++y) {
+            for (int x = dirty.left(); x <= dirty.right(); ++x) {
+                size_t p = size_t(y) * cur.w + x;
+                const float *t = &cur.mask[p * count];
+                if (coarse)
+                    expandAt(coarse->out, coarse->w, coarse->h, x, y, e);
+                float *o = &cur.out[p * 3];
+                o[0] = e[0];
+                o[1] = e[1];
+                o[2] = e[2];
+                for (int k = 0; k < count; ++k) {
+                    const float *lap = &cur.lap[k][p * 3];
+                    o[0] += lap[0] * t[k];
+                    o[1] += lap[1] * t[k];
+                    o[2] += lap[2] * t[k];
+                }
+            }
+        }
+        up = dirty;
+    }
+    // A small dab must leave the rest of the canvas alone
+    Q_ASSERT(up.isEmpty() || area.adjusted(-reach(), -reach(), reach(), reach()).contains(up));
+
+    for (int y = up.top(); y <= up.bottom(); ++y) {
+        QRgb *row = reinterpret_cast<QRgb*>(fusion.scanLine(y));
+        const float *src = &levels[0].out[size_t(y) * levels[0].w * 3];
+        for (int x = up.left(); x <= up.right(); ++x) {
+            const float *s = src + x * 3;
+            row[x] = qRgb(qBound(0, qRound(s[0]), 255),
+                          qBound(0, qRound(s[1]), 255),
+                          qBound(0, qRound(s[2]), 255));
+        }
+    }
+    return up;
+}
+
+} // namespace goo
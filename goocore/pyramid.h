@@ -0,0 +1,59 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <QImage>
+#include <QRect>
+#include <QVector>
+#include <vector>
+
+namespace goo {
+
+// Multi-band blend (Burt & Adelson): every source is split into a Laplacian
+// pyramid, its normalized weight into a Gaussian pyramid, and each band is
+// mixed with the weights at the matching scale before collapsing back to full
+// size. Every level keeps its collapsed result, so a mask edit only
+// recomputes the pixels its footprint reaches on the way down and back up
+// the pyramid: the dab plus a couple of pixels of filter support per level.
+class PyramidBlender {
+    static const int MaxLevels = 7;
+
+    struct Level {
+        int w = 0, h = 0;
+        std::vector<std::vector<float>> lap; // RGB band per source
+        std::vector<float> mask;             // Gaussian weights, one per source, summing to 1
+        std::vector<float> out;              // collapsed RGB result
+    };
+    std::vector<Level> levels;
+    int count = 0;
+
+    static void reduce(const std::vector<float> &src, int sw, int sh,
+                       std::vector<float> &dst, int dw, int ch, const QRect &area);
+    static int expandTaps(int x, int n, int *idx, float *w);
+    static void expandAt(const std::vector<float> &src, int sw, int sh, int x, int y, float *out);
+    static void buildLaplacian(const QImage &img, std::vector<Level> &lv, int source);
+
+    // Level-0 pixels an edit can reach beyond its own rect: about one coarse
+    // pixel per level on the way down and two fine ones per level back up
+    int reach() const { return 8 << (levels.size() - 1); }
+
+public:
+    bool isValid() const { return !levels.empty(); }
+
+    // The sources are 32-bit images already placed in canvas space, all the
+    // same size.
+    void setSources(const QVector<QImage> &sources);
+
+    // Rebuilds one source's bands, leaving the others alone
+    void setSource(int k, const QImage &source);
+
+    int sourceCount() const { return count; }
+
+    // Re-blends the part of the pyramid affected by a mask change inside
+    // 'area' of the weight planes and writes it into 'fusion', a 32-bit
+    // image the size of the sources. Returns the fusion rect that changed.
+    QRect update(const QVector<QImage> &planes, const QRect &area, QImage &fusion);
+};
+
+} // namespace goo
+
+#endif // PYRAMID_H
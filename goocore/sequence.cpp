@@ -0,0 +1,161 @@
+#include "sequence.h"
+#include "trace.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QRegularExpression>
+#include <QThread>
+#include <algorithm>
+
+namespace goo {
+
+bool decodeToFill(const QString &path, const QSize &size, QImage &dst) {
+    QImageReader reader(path);
+    const QSize full = reader.size();
+    if (full.isValid()) {
+        // Lets JPEG decode at a fraction of its size instead of scaling after
+        reader.setScaledSize(full.scaled(size, Qt::KeepAspectRatioByExpanding));
+        reader.setScaledClipRect(QRect(QPoint(0, 0), size));
+    }
+    if (!reader.read(&dst))
+        return false;
+    if (dst.size() != size)
+        dst = dst.scaled(size, Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation).copy(QRect(QPoint(0, 0), size));
+    if (dst.format() != QImage::Format_RGB32)
+        dst = dst.convertToFormat(QImage::Format_RGB32);
+    return true;
+}
+
+QStringList FrameSequence::findFrames(const QString &anyFrame) {
+    const QFileInfo info(anyFrame);
+    static const QRegularExpression numbered("^(.*?)(\\d+)(\\D*)$");
+    const QRegularExpressionMatch m = numbered.match(info.fileName());
+    if (!m.hasMatch())
+        return QStringList() << anyFrame;
+
+    const QString prefix = m.captured(1), suffix = m.captured(3);
+    QVector<QPair<qint64, QString>> run;
+    for (const QString &name : info.absoluteDir().entryList(QStringList() << prefix + "*" + suffix, QDir::Files)) {
+        const QString middle = name.mid(prefix.size(), name.size() - prefix.size() - suffix.size());
+        bool ok = false;
+        const qint64 number = middle.toLongLong(&ok);
+        if (ok && !middle.isEmpty() && middle.at(0).isDigit())
+            run.append(qMakePair(number, info.absoluteDir().filePath(name)));
+    }
+    if (run.size() < 2)
+        return QStringList() << anyFrame;
+    std::sort(run.begin(), run.end());
+
+    QStringList frames;
+    for (const auto &f : run)
+        frames << f.second;
+    return frames;
+}
+
+FrameSequence::FrameSequence(int ringSize) : ring(size_t(qMax(2, ringSize))) {}
+
+FrameSequence::~FrameSequence() { close(); }
+
+bool FrameSequence::open(const QString &path, const QSize &frameSize, bool sequence) {
+    close();
+    files = QStringList() << path;
+    if (sequence) {
+        // Start on the picked frame; the frames before it come round at the loop
+        const QStringList run = findFrames(path);
+        const int first = qMax(0, run.indexOf(QFileInfo(path).absoluteFilePath()));
+        files = run.mid(first) + run.mid(0, first);
+    }
+    size = frameSize;
+    blank = QImage(size, QImage::Format_RGB32);
+    blank.fill(Qt::black);
+
+    // The first frame is read here so there is something to show at once
+    // and a broken path fails now rather than in the background
+    if (!decodeToFill(files.first(), size, ring[0].image)) {
+        files.clear();
+        return false;
+    }
+    ring[0].n = 0;
+    filled = 1;
+    nextDecode = 1;
+    if (files.size() > 1) {
+        stopping = false;
+        decoder = QThread::create([this]() { decodeLoop(); });
+        decoder->setObjectName("FrameSequence decoder");
+        decoder->start(QThread::LowPriority);
+    }
+    return true;
+}
+
+void FrameSequence::close() {
+    if (decoder) {
+        {
+            QMutexLocker guard(&lock);
+            stopping = true;
+        }
+        slotFreed.wakeAll();
+        decoder->wait();
+        delete decoder;
+        decoder = nullptr;
+    }
+    files.clear();
+    for (Slot &s : ring) {
+        s.image = QImage();
+        s.n = -1;
+    }
+    readPos = filled = 0;
+    nextDecode = requested = 0;
+}
+
+const QImage &FrameSequence::frame(qint64 n) {
+    if (files.size() == 1)
+        return ring[0].image;
+
+    QMutexLocker guard(&lock);
+    if (!filled)
+        return blank;
+    requested = qMax(requested, n);
+
+    // Step past everything already due; frames we were too late for are
+    // dropped so playback keeps to the clock
+    const int cap = int(ring.size());
+    bool freed = false;
+    while (filled > 1 && ring[(readPos + 1) % cap].n <= n) {
+        readPos = (readPos + 1) % cap;
+        --filled;
+        freed = true;
+    }
+    if (freed)
+        slotFreed.wakeOne();
+    return ring[readPos].image;
+}
+
+void FrameSequence::decodeLoop() {
+    const int cap = int(ring.size());
+    for (;;) {
+        qint64 n;
+        int slot;
+        {
+            QMutexLocker guard(&lock);
+            while (!stopping && filled == cap)
+                slotFreed.wait(&lock);
+            if (stopping)
+                return;
+            // Behind the player: skip straight to what it wants next
+            n = qMax(nextDecode, requested);
+            slot = (readPos + filled) % cap;
+        }
+
+        // Slots past the filled range are the decoder's alone
+        GOO_TRACE_SCOPE("decode");
+        if (!decodeToFill(files.at(int(n % files.size())), size, ring[slot].image))
+            ring[slot].image = blank;
+
+        QMutexLocker guard(&lock);
+        ring[slot].n = n;
+        ++filled;
+        nextDecode = n + 1;
+    }
+}
+
+} // namespace goo
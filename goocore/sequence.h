@@ -0,0 +1,68 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <QImage>
+#include <QMutex>
+#include <QStringList>
+#include <QWaitCondition>
+#include <vector>
+
+class QThread;
+
+namespace goo {
+
+// Numbered frames (shot_0001.png, shot_0002.png, ...) played as a loop. A
+// decoder thread reads ahead into a fixed ring of buffers that are already
+// at the render size and in Format_RGB32, so whoever renders never waits on
+// disk or codecs. A still, or a run of one, is a one-frame sequence and is
+// decoded up front.
+class FrameSequence {
+public:
+    explicit FrameSequence(int ringSize = 8);
+    ~FrameSequence();
+
+    // Opens 'path' cropped and scaled to fill 'size' the way Fusion Animation
+    // always loaded its stills. Only with 'sequence' set does it play the run
+    // 'path' belongs to, starting from 'path' and looping back round to it;
+    // otherwise 'path' is a still even if it has a number in its name.
+    bool open(const QString &path, const QSize &size, bool sequence = false);
+    void close();
+
+    int frameCount() const { return files.size(); }
+
+    // Frame 'n', counting on past the end to loop. If the decoder has not
+    // got there yet this is the newest frame before it that is ready, so it
+    // never blocks. The image stays valid until the next call.
+    const QImage &frame(qint64 n);
+
+    // The files of the run 'anyFrame' is part of, in frame order
+    static QStringList findFrames(const QString &anyFrame);
+
+private:
+    struct Slot {
+        QImage image;
+        qint64 n = -1;
+    };
+
+    void decodeLoop();
+
+    QStringList files;
+    QSize size;
+    std::vector<Slot> ring;
+    int readPos = 0;          // slot being shown
+    int filled = 0;           // decoded slots from readPos on
+    qint64 nextDecode = 0;
+    qint64 requested = 0;     // newest frame asked for
+    bool stopping = false;
+    QMutex lock;
+    QWaitCondition slotFreed;
+    QThread *decoder = nullptr;
+    QImage blank;
+};
+
+// Reads 'path' straight at the size that fills 'size', then crops to it
+bool decodeToFill(const QString &path, const QSize &size, QImage &dst);
+
+} // namespace goo
+
+#endif // SEQUENCE_H
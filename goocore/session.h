@@ -0,0 +1,383 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <QFile>
+#include <QSaveFile>
+#include <QImage>
+#include <QMap>
+#include <QVector>
+#include <QtEndian>
+#include <climits>
+#include <cstring>
+#include <vector>
+
+// Project files shared by Goo and Fusion Room.
+//
+//   header   "GOOSESS\0", u32 version, u32 chunk count, u64 chunk table offset
+//   chunks   each 8-byte aligned
+//   table    per chunk: u32 tag, u32 id, u64 offset, u64 size
+//
+// Everything is little-endian. 'META' holds key=value lines, 'TILE' chunks
+// hold images cut into qCompress'd tiles behind an index, and anything else
+// is an opaque blob the app owns. The reader maps the whole file and hands
+// out chunks and tiles straight from the mapping, so opening a session only
+// reads the header and table; a tile is decompressed the first time
+// something asks for it.
+namespace goo {
+
+// A chunk tag: four characters, stored as they read
+constexpr quint32 sessionTag(char a, char b, char c, char d) {
+    return quint32(uchar(a)) | quint32(uchar(b)) << 8 | quint32(uchar(c)) << 16 | quint32(uchar(d)) << 24;
+}
+
+static const quint32 SessionTagMeta = sessionTag('M', 'E', 'T', 'A');
+static const quint32 SessionTagTiles = sessionTag('T', 'I', 'L', 'E');
+static const quint32 SessionTagHistory = sessionTag('H', 'I', 'S', 'T');
+
+class SessionWriter {
+    static const int HeaderSize = 24;
+
+    struct Entry {
+        quint32 tag, id;
+        quint64 offset, size;
+    };
+    QSaveFile file;
+    QVector<Entry> entries;
+    quint64 pos = 0;
+    bool ok = true;
+
+    static void put32(QByteArray &b, quint32 v) {
+        v = qToLittleEndian(v);
+        b.append(reinterpret_cast<const char*>(&v), 4);
+    }
+    static void put64(QByteArray &b, quint64 v) {
+        v = qToLittleEndian(v);
+        b.append(reinterpret_cast<const char*>(&v), 8);
+    }
+
+    void write(const QByteArray &b) {
+        ok = ok && file.write(b) == b.size();
+        pos += b.size();
+    }
+
+    void align() {
+        if (pos % 8)
+            write(QByteArray(int(8 - pos % 8), '\0'));
+    }
+
+public:
+    explicit SessionWriter(const QString &path) : file(path) {}
+
+    bool open() {
+        if (!file.open(QIODevice::WriteOnly))
+            return false;
+        write(QByteArray(HeaderSize, '\0')); // filled in by finish()
+        return ok;
+    }
+
+    void addBlob(quint32 tag, quint32 id, const QByteArray &data) {
+        align();
+        Entry e = { tag, id, pos, quint64(data.size()) };
+        entries.append(e);
+        write(data);
+    }
+
+    void addMeta(const QMap<QString, QString> &meta) {
+        QByteArray text;
+        for (auto it = meta.constBegin(); it != meta.constEnd(); ++it)
+            text += it.key().toUtf8() + '=' + it.value().toUtf8() + '\n';
+        addBlob(SessionTagMeta, 0, text);
+    }
+
+    // Chunk: u32 width, height, format, tile size, tiles across, tiles down,
+    // then per tile u64 offset and u32 packed, u32 raw size, then the tiles.
+    void addImage(quint32 id, const QImage &img, int tileSize = 256) {
+        const int tilesX = (img.width() + tileSize - 1) / tileSize;
+        const int tilesY = (img.height() + tileSize - 1) / tileSize;
+        const int bpp = img.depth() / 8;
+
+        QVector<QByteArray> packed;
+        QVector<int> rawSizes;
+        for (int ty = 0; ty < tilesY; ++ty) {
+            for (int tx = 0; tx < tilesX; ++tx) {
+                QRect r = QRect(tx * tileSize, ty * tileSize, tileSize, tileSize).intersected(img.rect());
+                QByteArray raw(r.width() * r.height() * bpp, Qt::Uninitialized);
+                for (int y = 0; y < r.height(); ++y)
+                    memcpy(raw.data() + y * r.width() * bpp, img.constScanLine(r.top() + y) + r.left() * bpp, r.width() * bpp);
+                packed.append(qCompress(raw));
+                rawSizes.append(raw.size());
+            }
+        }
+
+        align();
+        QByteArray head;
+        put32(head, img.width());
+        put32(head, img.height());
+        put32(head, img.format());
+        put32(head, tileSize);
+        put32(head, tilesX);
+        put32(head, tilesY);
+        quint64 at = pos + head.size() + quint64(packed.size()) * 16;
+        for (int i = 0; i < packed.size(); ++i) {
+            put64(head, at);
+            put32(head, packed[i].size());
+            put32(head, rawSizes[i]);
+            at += packed[i].size();
+        }
+
+        Entry e = { SessionTagTiles, id, pos, at - pos };
+        entries.append(e);
+        write(head);
+        for (const QByteArray &p : packed)
+            write(p);
+    }
+
+    // Writes the chunk table and commits the file in one step
+    bool finish() {
+        align();
+        const quint64 tableOffset = pos;
+        QByteArray table;
+        for (const Entry &e : entries) {
+            put32(table, e.tag);
+            put32(table, e.id);
+            put64(table, e.offset);
+            put64(table, e.size);
+        }
+        write(table);
+
+        QByteArray header("GOOSESS", 8);
+        put32(header, 1);
+        put32(header, entries.size());
+        put64(header, tableOffset);
+        ok = ok && file.seek(0) && file.write(header) == header.size();
+        return ok && file.commit();
+    }
+};
+
+class SessionReader {
+    static const quint32 MaxSide = 1 << 16;
+
+    struct Entry {
+        quint32 tag, id;
+        quint64 offset, size;
+    };
+    QFile file;
+    const uchar *base = nullptr;
+    quint64 length = 0;
+    QVector<Entry> entries;
+
+    static quint32 get32(const uchar *p) { return qFromLittleEndian<quint32>(p); }
+    static quint64 get64(const uchar *p) { return qFromLittleEndian<quint64>(p); }
+
+    const Entry *find(quint32 tag, quint32 id) const {
+        for (const Entry &e : entries)
+            if (e.tag == tag && e.id == id)
+                return &e;
+        return nullptr;
+    }
+
+    struct ImageHead {
+        int width, height, tile, tilesX, tilesY;
+        QImage::Format format;
+        const uchar *index;
+    };
+
+    // Parses and checks an image chunk's header, so nothing a corrupt file
+    // says gets used as a size, format or offset unchecked
+    bool imageHead(quint32 id, ImageHead &h) const {
+        const Entry *e = find(SessionTagTiles, id);
+        if (!e || e->size < 24)
+            return false;
+        const uchar *p = base + e->offset;
+        const quint32 w = get32(p), ht = get32(p + 4), format = get32(p + 8), tile = get32(p + 12);
+        if (w < 1 || ht < 1 || w > MaxSide || ht > MaxSide || tile < 1 || tile > MaxSide
+            || format <= QImage::Format_Invalid || format >= QImage::NImageFormats)
+            return false;
+        h.width = int(w);
+        h.height = int(ht);
+        h.tile = int(tile);
+        h.format = QImage::Format(format);
+        h.tilesX = (h.width + h.tile - 1) / h.tile;
+        h.tilesY = (h.height + h.tile - 1) / h.tile;
+        if (get32(p + 16) != quint32(h.tilesX) || get32(p + 20) != quint32(h.tilesY)
+            || quint64(h.tilesX) * h.tilesY * 16 > e->size - 24)
+            return false;
+        h.index = p + 24;
+        return true;
+    }
+
+public:
+    ~SessionReader() { close(); }
+
+    bool open(const QString &path) {
+        close();
+        file.setFileName(path);
+        if (!file.open(QIODevice::ReadOnly) || file.size() < 24)
+            return false;
+        length = quint64(file.size());
+        base = file.map(0, file.size());
+        if (!base || memcmp(base, "GOOSESS", 8) != 0 || get32(base + 8) != 1) {
+            close();
+            return false;
+        }
+
+        const quint32 count = get32(base + 12);
+        const quint64 table = get64(base + 16);
+        if (table > length || quint64(count) * 24 > length - table) {
+            close();
+            return false;
+        }
+        for (quint32 i = 0; i < count; ++i) {
+            const uchar *p = base + table + i * 24;
+            Entry e = { get32(p), get32(p + 4), get64(p + 8), get64(p + 16) };
+            if (e.offset > length || e.size > length - e.offset) {
+                close();
+                return false;
+            }
+            entries.append(e);
+        }
+        return true;
+    }
+
+    void close() {
+        if (base)
+            file.unmap(const_cast<uchar*>(base));
+        base = nullptr;
+        entries.clear();
+        file.close();
+    }
+
+    bool isOpen() const { return base != nullptr; }
+
+    // Points into the mapping: valid until close()
+    QByteArray blob(quint32 tag, quint32 id = 0) const {
+        const Entry *e = find(tag, id);
+        return e ? QByteArray::fromRawData(reinterpret_cast<const char*>(base + e->offset), int(e->size)) : QByteArray();
+    }
+
+    QMap<QString, QString> meta() const {
+        QMap<QString, QString> m;
+        for (const QByteArray &line : blob(SessionTagMeta).split('\n')) {
+            int eq = line.indexOf('=');
+            if (eq > 0)
+                m.insert(QString::fromUtf8(line.left(eq)), QString::fromUtf8(line.mid(eq + 1)));
+        }
+        return m;
+    }
+
+    bool hasImage(quint32 id) const { return find(SessionTagTiles, id) != nullptr; }
+
+    // An uninitialized image of the stored size and format, to load tiles into
+    // (null if the chunk is missing or its header is corrupt)
+    QImage allocImage(quint32 id) const {
+        ImageHead h;
+        if (!imageHead(id, h))
+            return QImage();
+        return QImage(h.width, h.height, h.format);
+    }
+
+    // 0 if the chunk is missing or corrupt
+    int tileSize(quint32 id) const {
+        ImageHead h;
+        return imageHead(id, h) ? h.tile : 0;
+    }
+
+    // Decompresses tile (tx, ty) of image 'id' into the same place in 'dst',
+    // which must have the stored size and format (see allocImage)
+    bool readTile(quint32 id, int tx, int ty, QImage &dst) const {
+        ImageHead h;
+        if (!imageHead(id, h) || dst.size() != QSize(h.width, h.height) || dst.format() != h.format)
+            return false;
+        if (tx < 0 || ty < 0 || tx >= h.tilesX || ty >= h.tilesY)
+            return false;
+        const uchar *index = h.index + (quint64(ty) * h.tilesX + tx) * 16;
+        const quint64 offset = get64(index);
+        const quint32 packed = get32(index + 8);
+        const QRect r = QRect(tx * h.tile, ty * h.tile, h.tile, h.tile).intersected(dst.rect());
+        const int rowBytes = r.width() * dst.depth() / 8;
+        // qUncompress allocates whatever its 4-byte prefix asks for
+        if (packed < 4 || offset > length || packed > length - offset || packed > quint32(INT_MAX)
+            || get32(index + 12) != quint32(rowBytes) * r.height()
+            || qFromBigEndian<quint32>(base + offset) != quint32(rowBytes) * r.height())
+            return false;
+
+        const QByteArray raw = qUncompress(base + offset, int(packed));
+        if (raw.size() != rowBytes * r.height())
+            return false;
+        for (int y = 0; y < r.height(); ++y)
+            memcpy(dst.scanLine(r.top() + y) + r.left() * dst.depth() / 8, raw.constData() + y * rowBytes, rowBytes);
+        return true;
+    }
+
+    // Loads every tile; for images that are always fully on screen
+    bool readImage(quint32 id, QImage &dst) const {
+        const int tile = tileSize(id);
+        if (!tile)
+            return false;
+        for (int ty = 0; ty * tile < dst.height(); ++ty)
+            for (int tx = 0; tx * tile < dst.width(); ++tx)
+                if (!readTile(id, tx, ty, dst))
+                    return false;
+        return true;
+    }
+};
+
+// Fills an image from a session one tile at a time, as areas of it are
+// needed. The reader has to stay open until everything is loaded.
+class LazyTiles {
+    const SessionReader *reader = nullptr;
+    quint32 id = 0;
+    int tile = 0, tilesX = 0;
+    std::vector<bool> loaded;
+    int remaining = 0;
+
+public:
+    // False (and nothing pending) if the image chunk is missing or corrupt
+    bool reset(const SessionReader *r, quint32 imageId, const QImage &dst) {
+        clear();
+        tile = r->tileSize(imageId);
+        if (!tile)
+            return false;
+        reader = r;
+        id = imageId;
+        tilesX = (dst.width() + tile - 1) / tile;
+        remaining = tilesX * ((dst.height() + tile - 1) / tile);
+        loaded.assign(remaining, false);
+        return true;
+    }
+
+    void clear() {
+        reader = nullptr;
+        loaded.clear();
+        remaining = 0;
+    }
+
+    bool pending() const { return remaining > 0; }
+
+    // Returns the bounds of the tiles it loaded. A tile that fails to read
+    // stays pending.
+    QRect ensure(QImage &dst, const QRect &area) {
+        QRect r = area.intersected(dst.rect()), fresh;
+        if (!remaining || r.isEmpty())
+            return fresh;
+        for (int ty = r.top() / tile; ty <= r.bottom() / tile; ++ty) {
+            for (int tx = r.left() / tile; tx <= r.right() / tile; ++tx) {
+                int i = ty * tilesX + tx;
+                if (loaded[i])
+                    continue;
+                if (!reader->readTile(id, tx, ty, dst))
+                    continue;
+                loaded[i] = true;
+                --remaining;
+                fresh |= QRect(tx * tile, ty * tile, tile, tile).intersected(dst.rect());
+            }
+        }
+        return fresh;
+    }
+
+    QRect ensureAll(QImage &dst) { return ensure(dst, dst.rect()); }
+};
+
+} // namespace goo
+
+#endif // SESSION_H
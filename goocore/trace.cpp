@@ -0,0 +1,202 @@
+#include "trace.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QSaveFile>
+#include <QThread>
+#include <QTextStream>
+#include <vector>
+
+namespace goo {
+namespace trace {
+
+std::atomic<bool> active(false);
+
+namespace {
+
+struct Event {
+    const char *name;
+    qint64 start, end;
+};
+
+// One per live thread that has recorded. Only its own thread writes; a
+// dump reads it from outside, checking the head on both sides of the copy.
+// When the thread exits the ring goes back on a free list and the next new
+// thread carries on in it, under the same tid, so short-lived threads do
+// not each leave one behind; their spans stay until overwritten.
+struct Ring {
+    static const quint64 Capacity = 1 << 14;
+    std::vector<Event> events;
+    std::atomic<quint64> head;
+    int tid;
+    QString threadName;
+
+    Ring() : events(Capacity), head(0), tid(0) {}
+};
+
+QMutex registryLock;
+std::vector<Ring*> &registry() {
+    // Never freed: threads may exit before the trace is written
+    static std::vector<Ring*> *rings = new std::vector<Ring*>;
+    return *rings;
+}
+
+std::vector<Ring*> &freeRings() {
+    static std::vector<Ring*> *rings = new std::vector<Ring*>;
+    return *rings;
+}
+
+// Returns the thread's ring when the thread exits
+struct RingOwner {
+    Ring *ring = nullptr;
+
+    ~RingOwner() {
+        if (!ring)
+            return;
+        QMutexLocker guard(&registryLock);
+        freeRings().push_back(ring);
+    }
+};
+
+thread_local RingOwner localRing;
+
+QElapsedTimer &clock() {
+    static QElapsedTimer timer;
+    static bool started = (timer.start(), true);
+    Q_UNUSED(started);
+    return timer;
+}
+
+QString tracePath;
+
+Ring *registerThread() {
+    QThread *thread = QThread::currentThread();
+    QString name = thread ? thread->objectName() : QString();
+    QMutexLocker guard(&registryLock);
+    Ring *ring;
+    if (!freeRings().empty()) {
+        ring = freeRings().back();
+        freeRings().pop_back();
+    } else {
+        ring = new Ring;
+        ring->tid = int(registry().size()) + 1;
+        registry().push_back(ring);
+    }
+    if (name.isEmpty()) {
+        QCoreApplication *app = QCoreApplication::instance();
+        name = app && thread == app->thread() ? QString("main") : QString("thread %1").arg(ring->tid);
+    }
+    ring->threadName = name;
+    return ring;
+}
+
+void dumpAtExit() {
+    if (!tracePath.isEmpty())
+        dump(tracePath);
+}
+
+QString jsonString(QString s) {
+    s.replace("\\", "\\\\");
+    s.replace("\"", "\\\"");
+    return "\"" + s + "\"";
+}
+
+} // namespace
+
+void setEnabled(bool on) {
+    clock();
+    active.store(on, std::memory_order_relaxed);
+}
+
+qint64 now() { return clock().nsecsElapsed(); }
+
+void record(const char *name, qint64 start, qint64 end) {
+    Ring *ring = localRing.ring;
+    if (!ring)
+        ring = localRing.ring = registerThread();
+    const quint64 h = ring->head.load(std::memory_order_relaxed);
+    Event &e = ring->events[h % Ring::Capacity];
+    e.name = name;
+    e.start = start;
+    e.end = end;
+    ring->head.store(h + 1, std::memory_order_release);
+}
+
+bool dump(const QString &path) {
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    QTextStream out(&file);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    // Names change when a ring is handed to a new thread
+    std::vector<Ring*> rings;
+    QStringList names;
+    {
+        QMutexLocker guard(&registryLock);
+        rings = registry();
+        for (Ring *ring : rings)
+            names << ring->threadName;
+    }
+    const qint64 pid = QCoreApplication::applicationPid();
+    bool first = true;
+    for (size_t r = 0; r < rings.size(); ++r) {
+        Ring *ring = rings[r];
+        const quint64 end = ring->head.load(std::memory_order_acquire);
+        const quint64 begin = end > Ring::Capacity ? end - Ring::Capacity : 0;
+        std::vector<Event> copy;
+        copy.reserve(size_t(end - begin));
+        for (quint64 i = begin; i < end; ++i)
+            copy.push_back(ring->events[i % Ring::Capacity]);
+        // Anything the thread lapped while we copied may be torn
+        const quint64 after = ring->head.load(std::memory_order_acquire);
+        // (slot 'after - Capacity' may be mid-write as the head reads 'after')
+        const quint64 safe = after + 1 > Ring::Capacity ? after + 1 - Ring::Capacity : 0;
+        const size_t skip = size_t(safe > begin ? qMin(safe - begin, end - begin) : 0);
+
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << ring->tid
+            << ",\"args\":{\"name\":" << jsonString(names[int(r)]) << "}}";
+        first = false;
+        for (size_t i = skip; i < copy.size(); ++i) {
+            const Event &e = copy[i];
+            out << ",\n{\"name\":" << jsonString(QString::fromLatin1(e.name)) << ",\"ph\":\"X\",\"pid\":" << pid
+                << ",\"tid\":" << ring->tid << ",\"ts\":" << QString::number(e.start / 1000.0, 'f', 3)
+                << ",\"dur\":" << QString::number((e.end - e.start) / 1000.0, 'f', 3) << "}";
+        }
+    }
+    out << "\n]}\n";
+    out.flush();
+    return file.commit();
+}
+
+void clear() {
+    QMutexLocker guard(&registryLock);
+    for (Ring *ring : registry())
+        ring->head.store(0, std::memory_order_release);
+}
+
+void startFromEnvironment() {
+    tracePath = QString::fromLocal8Bit(qgetenv("GOO_TRACE"));
+    if (tracePath.isEmpty())
+        return;
+    setEnabled(true);
+    qAddPostRoutine(dumpAtExit);
+}
+
+QString toggle() {
+    if (!enabled()) {
+        clear();
+        setEnabled(true);
+        return QString();
+    }
+    setEnabled(false);
+    QString path = tracePath;
+    if (path.isEmpty())
+        path = QDir::temp().filePath(QCoreApplication::applicationName() + "-trace.json");
+    return dump(path) ? path : QString();
+}
+
+} // namespace trace
+} // namespace goo
@@ -0,0 +1,78 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <atomic>
+
+// Scoped-span tracing for every app and tool.
+//
+//   void updateFusion() {
+//       GOO_TRACE_SCOPE("updateFusion");
+//       ...
+//   }
+//
+// Each thread appends finished spans to its own fixed ring, with no locks
+// and no allocation, and the rings are written out as Chrome trace-event
+// JSON (chrome://tracing, Perfetto) on demand. While tracing is off a span
+// costs one relaxed atomic load, so the calls stay in release builds;
+// define GOO_NO_TRACE to compile them out altogether.
+//
+// GOO_TRACE=<file> in the environment traces the whole run and writes the
+// file on exit; the apps also toggle tracing with Ctrl+Shift+T (see
+// tracetoggle.h).
+namespace goo {
+namespace trace {
+
+extern std::atomic<bool> active;
+
+inline bool enabled() { return active.load(std::memory_order_relaxed); }
+void setEnabled(bool on);
+
+// Nanoseconds on a clock shared by all threads
+qint64 now();
+
+// 'name' must outlive the trace: a string literal
+void record(const char *name, qint64 start, qint64 end);
+
+// Writes every ring out as Chrome trace JSON. Spans that are overwritten
+// while they are being copied are left out rather than written torn.
+bool dump(const QString &path);
+void clear();
+
+// Honours GOO_TRACE; call once the QCoreApplication exists
+void startFromEnvironment();
+
+// Starts tracing, or stops it and writes the trace. Returns the file
+// written, empty when it just started or the write failed.
+QString toggle();
+
+} // namespace trace
+
+class TraceSpan {
+public:
+    explicit TraceSpan(const char *spanName) : name(spanName), start(trace::enabled() ? trace::now() : -1) {}
+    ~TraceSpan() {
+        if (start >= 0)
+            trace::record(name, start, trace::now());
+    }
+
+private:
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    const char *name;
+    qint64 start;
+};
+
+} // namespace goo
+
+#define GOO_TRACE_CAT2(a, b) a##b
+#define GOO_TRACE_CAT(a, b) GOO_TRACE_CAT2(a, b)
+
+#ifdef GOO_NO_TRACE
+#define GOO_TRACE_SCOPE(name) do {} while (0)
+#else
+#define GOO_TRACE_SCOPE(name) goo::TraceSpan GOO_TRACE_CAT(gooTraceSpan, __LINE__)(name)
+#endif
+
+#endif // TRACE_H
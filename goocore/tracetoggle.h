@@ -0,0 +1,27 @@
+#ifndef TRACETOGGLE_H
+#define TRACETOGGLE_H
+
+#include <QKeySequence>
+#include <QMessageBox>
+#include <QShortcut>
+#include <QWidget>
+#include "trace.h"
+
+namespace goo {
+namespace trace {
+
+// Ctrl+Shift+T on 'window' starts tracing, or stops it and says where the
+// trace went. Header only, as goocore itself does not link QtWidgets.
+inline void installToggleShortcut(QWidget *window) {
+    QObject::connect(new QShortcut(QKeySequence("Ctrl+Shift+T"), window), &QShortcut::activated, window, [window]() {
+        const bool wasTracing = enabled();
+        const QString written = toggle();
+        if (wasTracing)
+            QMessageBox::information(window, "Trace", written.isEmpty() ? QString("Could not write the trace") : "Trace written to " + written);
+    });
+}
+
+} // namespace trace
+} // namespace goo
+
+#endif // TRACETOGGLE_H
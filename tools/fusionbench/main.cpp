@@ -0,0 +1,242 @@
+// fusionbench: times each stage of the Fusion Animation frame, headless.
+//
+//   fusionbench [--frames N] [--warmup N] [--sizes 512x512,1920x1080]
+//               [--threads 1,2,4] [--a face.png --b face.png]
+//               [--no-fractal] [--out result.json]
+//
+// Every resolution is run at every thread count with the same fixed
+// parameters. The result is one JSON document with the p50/p95/p99 time of
+// each stage and of the whole frame in milliseconds, so builds can be
+// diffed. Runs on the offscreen platform unless QT_QPA_PLATFORM is set.
+// GOO_TRACE=<file> also writes a Chrome trace of every frame.
+
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QFile>
+#include <QImage>
+#include <QPainter>
+#include <QTextStream>
+#include <QThread>
+#include <QSysInfo>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "pipeline.h"
+#include "trace.h"
+
+typedef goo::FusionPipeline Pipeline;
+
+// Stages timed outside the pipeline
+enum {
+    Stage_Present = Pipeline::StageCount, // the frame drawn into a backing store, as FrameView does
+    Stage_Total,
+    BenchStageCount
+};
+
+static QImage loadAndResize(const QString &path, QSize size) {
+    QImage img(path);
+    if (img.isNull())
+        return img;
+    return img.scaled(size, Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation)
+              .copy(QRect(QPoint(0, 0), size)).convertToFormat(QImage::Format_RGB32);
+}
+
+// Stand-in face when no images are given: smooth gradients with some detail
+static QImage testCard(QSize size, int seed) {
+    QImage img(size, QImage::Format_RGB32);
+    for (int y = 0; y < size.height(); ++y) {
+        QRgb *row = reinterpret_cast<QRgb*>(img.scanLine(y));
+        for (int x = 0; x < size.width(); ++x)
+            row[x] = qRgb((x * 255 / size.width() + seed * 60) & 0xff,
+                          (y * 255 / size.height()) & 0xff,
+                          ((x ^ y) + seed * 90) & 0xff);
+    }
+    return img;
+}
+
+static bool parseSizes(const QString &text, QVector<QSize> &sizes) {
+    for (const QString &item : text.split(',')) {
+        const QStringList wh = item.trimmed().split('x');
+        const int w = wh.value(0).toInt(), h = wh.value(1).toInt();
+        if (wh.size() != 2 || w <= 0 || h <= 0)
+            return false;
+        sizes.append(QSize(w, h));
+    }
+    return !sizes.isEmpty();
+}
+
+static bool parseCounts(const QString &text, QVector<int> &counts) {
+    for (const QString &item : text.split(',')) {
+        const int n = item.trimmed().toInt();
+        if (n <= 0)
+            return false;
+        counts.append(n);
+    }
+    return !counts.isEmpty();
+}
+
+// Nearest-rank percentile of sorted nanosecond samples, in milliseconds
+static double percentile(const std::vector<qint64> &sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    const size_t rank = size_t(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[qBound<size_t>(1, rank, sorted.size()) - 1] / 1e6;
+}
+
+static QJsonObject summarize(std::vector<qint64> &samples) {
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (qint64 s : samples)
+        sum += s;
+    QJsonObject o;
+    o["p50"] = percentile(samples, 50);
+    o["p95"] = percentile(samples, 95);
+    o["p99"] = percentile(samples, 99);
+    o["mean"] = samples.empty() ? 0.0 : sum / samples.size() / 1e6;
+    o["max"] = samples.empty() ? 0.0 : samples.back() / 1e6;
+    return o;
+}
+
+int main(int argc, char *argv[]) {
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+    goo::trace::startFromEnvironment();
+    QTextStream out(stdout), err(stderr);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Per-stage frame times of the Fusion Animation pipeline.");
+    parser.addHelpOption();
+    QCommandLineOption framesOption("frames", "Timed frames per run (default 300).", "n", "300");
+    QCommandLineOption warmupOption("warmup", "Untimed frames before each run (default 20).", "n", "20");
+    QCommandLineOption sizesOption("sizes", "Resolutions, WxH separated by commas.", "list", "512x512,1024x1024,1920x1080");
+    QCommandLineOption threadsOption("threads", "Thread counts, separated by commas (default 1, 2, 4 .. all cores).", "list");
+    QCommandLineOption aOption("a", "Face A (default: generated).", "image");
+    QCommandLineOption bOption("b", "Face B (default: generated).", "image");
+    QCommandLineOption noFractalOption("no-fractal", "Skip the fractal background, as the app does now.");
+    QCommandLineOption outOption("out", "Write the JSON here instead of stdout.", "file");
+    parser.addOptions({ framesOption, warmupOption, sizesOption, threadsOption, aOption, bOption, noFractalOption, outOption });
+    parser.process(app);
+
+    const int frames = parser.value(framesOption).toInt();
+    const int warmup = qMax(0, parser.value(warmupOption).toInt());
+    QVector<QSize> sizes;
+    QVector<int> threadCounts;
+    if (frames <= 0 || !parseSizes(parser.value(sizesOption), sizes)) {
+        err << "fusionbench: bad --frames or --sizes\n";
+        return 1;
+    }
+    if (parser.isSet(threadsOption)) {
+        if (!parseCounts(parser.value(threadsOption), threadCounts)) {
+            err << "fusionbench: bad --threads\n";
+            return 1;
+        }
+    } else {
+        const int cores = QThread::idealThreadCount();
+        for (int n = 1; n < cores; n *= 2)
+            threadCounts.append(n);
+        threadCounts.append(cores);
+    }
+
+    // Fixed mid-range settings so runs are comparable
+    Pipeline::Params params;
+    params.blend = 0.5f;
+    params.warp = 20;
+    params.spin = 30;
+    params.zoom = 1.5;
+    params.fractal = !parser.isSet(noFractalOption);
+
+    QJsonArray runs;
+    for (const QSize &size : sizes) {
+        QImage a = parser.isSet(aOption) ? loadAndResize(parser.value(aOption), size) : testCard(size, 0);
+        QImage b = parser.isSet(bOption) ? loadAndResize(parser.value(bOption), size) : testCard(size, 1);
+        if (a.isNull() || b.isNull()) {
+            err << "fusionbench: could not load the input images\n";
+            return 1;
+        }
+
+        for (int threads : threadCounts) {
+            goo::setThreadCount(threads);
+            Pipeline pipeline;
+            QImage screen(size, QImage::Format_ARGB32_Premultiplied);
+            std::vector<qint64> samples[BenchStageCount];
+            for (std::vector<qint64> &s : samples)
+                s.reserve(frames);
+
+            for (int f = 0; f < warmup + frames; ++f) {
+                qint64 ns[Pipeline::StageCount];
+                QElapsedTimer total, present;
+                total.start();
+                const QImage &frame = pipeline.render(a, b, params, f, ns);
+                present.start();
+                {
+                    QPainter p(&screen);
+                    p.drawImage(0, 0, frame);
+                }
+                const qint64 presentNs = present.nsecsElapsed();
+                const qint64 totalNs = total.nsecsElapsed();
+                if (f < warmup)
+                    continue;
+                for (int s = 0; s < Pipeline::StageCount; ++s)
+                    samples[s].push_back(ns[s]);
+                samples[Stage_Present].push_back(presentNs);
+                samples[Stage_Total].push_back(totalNs);
+            }
+
+            QJsonObject stages;
+            for (int s = 0; s < Pipeline::StageCount; ++s)
+                if (s != Pipeline::Stage_Fractal || params.fractal)
+                    stages[Pipeline::stageName(s)] = summarize(samples[s]);
+            stages["present"] = summarize(samples[Stage_Present]);
+
+            QJsonObject run;
+            run["width"] = size.width();
+            run["height"] = size.height();
+            run["threads"] = goo::threadCount();
+            run["stages"] = stages;
+            run["total"] = summarize(samples[Stage_Total]);
+            runs.append(run);
+
+            err << size.width() << "x" << size.height() << ", " << threads << " threads: p50 "
+                << QString::number(run["total"].toObject()["p50"].toDouble(), 'f', 2) << " ms, p99 "
+                << QString::number(run["total"].toObject()["p99"].toDouble(), 'f', 2) << " ms\n";
+            err.flush();
+        }
+    }
+
+    QJsonObject settings;
+    settings["blend"] = params.blend;
+    settings["warp"] = params.warp;
+    settings["spin"] = params.spin;
+    settings["zoom"] = params.zoom;
+    settings["fractal"] = params.fractal;
+    settings["tiles"] = params.tiles;
+    settings["a"] = parser.isSet(aOption) ? parser.value(aOption) : QString("generated");
+    settings["b"] = parser.isSet(bOption) ? parser.value(bOption) : QString("generated");
+
+    QJsonObject result;
+    result["benchmark"] = "fusionbench";
+    result["qt"] = QString(qVersion());
+    result["cpu"] = QSysInfo::currentCpuArchitecture();
+    result["cores"] = QThread::idealThreadCount();
+    result["frames"] = frames;
+    result["warmup"] = warmup;
+    result["params"] = settings;
+    result["runs"] = runs;
+    const QByteArray json = QJsonDocument(result).toJson();
+
+    if (parser.isSet(outOption)) {
+        QFile file(parser.value(outOption));
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+            err << "fusionbench: could not write " << parser.value(outOption) << "\n";
+            return 1;
+        }
+    } else {
+        out << json;
+    }
+    return 0;
+}